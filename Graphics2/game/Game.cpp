@@ -1,6 +1,7 @@
 #include "Game.h"
 #include <iostream>
 #include "../renderer/Cube.h"
+#include "../renderer/GLState.h"
 #include "../renderer/glm/gtc/matrix_transform.hpp"
 
 
@@ -11,6 +12,10 @@
 
 #define OCTDEPTH 4
 
+//Memory terrain chunks may use across all planets before unused ones are evicted
+#define TERRAIN_CPU_BUDGET (64 << 20)
+#define TERRAIN_GPU_BUDGET (48 << 20)
+
 #define DIAL_TIME 0.5f
 
 #define DIAL_DISTANCE 50.0f
@@ -41,13 +46,14 @@ void loadAssets(Game* game) {
 	game->player = new Player();
 	game->player->setGame(game);
 	game->player->getShip()->createOctrees(0);
-	game->worldPos = glm::vec3(32000.0f, 0.0f, 0.0f);
+	game->worldPos = glm::dvec3(32000.0, 0.0, 0.0);
 	//Portal
 	game->portal = new Portal();
 	game->portal->initPortalMap();
 	game->portal->portalScale = game->lowLodScale;
 	game->portal->portalSurface = new Model();
 	game->portal->portalSurface->loadModel("assets/portal/portal.obj");
+	game->portal->setLocalBounds(game->portal->portalSurface->getBounds());
 	game->portal->setRotation(glm::quat(glm::vec3(-glm::half_pi<float>(), 0.0f, 0.0f)));
 	game->portal->setPosition(glm::vec3(40000.0f, 0.0f, -10.0f));
 	game->portal->exitPortal = new SceneObject();
@@ -64,6 +70,9 @@ void loadAssets(Game* game) {
 	game->gate->setParent(game->transformedSpace);
 	game->gate->setPosition(glm::vec3(40000.0f, 0.0f, -10.0f));
 	game->gate->setRotation(glm::quat(glm::vec3(-glm::half_pi<float>(), 0.0f, 0.0f)));
+	for (Mesh* m : game->gate->meshes) {
+		m->occluder = true;
+	}
 	std::cout << "All assets loaded" << std::endl;
 
 }
@@ -71,7 +80,9 @@ void loadAssets(Game* game) {
 void generateTerrain(Game* game) {
 	//Home planet
 	std::cout << "Generating terrain..." << std::endl;
+	game->terrainResidency = new ChunkResidency(TERRAIN_CPU_BUDGET, TERRAIN_GPU_BUDGET);
 	game->homeWorld = new Planet();
+	game->homeWorld->setResidency(game->terrainResidency);
 	game->homeWorld->planetScale = 30000.0f;
 	game->homeWorld->lowLodScale = game->lowLodScale;
 	float lod[] = { 2000.0f, 4000.0f, 8000.0f};
@@ -87,6 +98,7 @@ void generateTerrain(Game* game) {
 	std::cout << "Homeworld generated" << std::endl;
 	//Other planet
 	game->otherWorld = new Planet();
+	game->otherWorld->setResidency(game->terrainResidency);
 	game->otherWorld->planetScale = 15000.0f;
 	game->otherWorld->lowLodScale = game->lowLodScale;
 	float lod2[] = { 2000.0f, 4000.0f, 8000.0f};
@@ -103,9 +115,11 @@ void generateTerrain(Game* game) {
 	game->otherWorld->setNodeExp(6);
 	//Generate terrain
 	game->otherWorld->generateTerrain(OCTDEPTH);
+	game->secondLowLodScene->setOccluder(game->secondLowLodScene, game->otherWorld->getOccluderRadius() * game->lowLodScale);
 	SceneObject h;
 	std::unordered_set<Mesh*> hp;
 	game->otherWorld->updateVisible(&h, game->secondLowLodScene, game->portal->exitPortal->getPosition() / game->lowLodScale, hp);
+	game->otherWorld->updateTransitions(&h, game->secondLowLodScene, hp, true);
 	std::cout << "Terrain generated" << std::endl;
 }
 
@@ -117,6 +131,8 @@ Game::Game() {
 	//Space local to the ship
 	transformedSpace = new SceneObject();
 	transformedSpace->setParent(scene);
+	//Terrain stays still within it, so its shadows can be kept while the ship flies
+	scene->setStaticRoot(transformedSpace);
 	//Second planet
 	secondScene = new Scene();
 	//Low resolution version of second planet
@@ -129,6 +145,8 @@ Game::Game() {
 	DirectionalLight* sunLight = new DirectionalLight();
 	sunLight->colour = glm::vec3(0.8f, 0.8f, 0.8f);
 	sunLight->direction = glm::vec3(0.0f, -1.0f, 0.0f);
+	//Reaches far enough for the orbital camera to see the ship's shadow
+	sunLight->getShadowMap().setDistance(150.0f);
 	sunLight->setParent(scene);
 	sunLight = new DirectionalLight();
 	sunLight->colour = glm::vec3(0.8f, 0.8f, 0.8f);
@@ -158,6 +176,9 @@ Game::Game() {
 	lowSunLight->colour = glm::vec3(0.8f, 0.8f, 0.8f);
 	lowSunLight->direction = glm::vec3(0.0f, -1.0f, 0.0f);
 	lowSunLight->setParent(lowLodScene);
+	//Terrain detail is chosen by how it looks through the distant camera
+	homeWorld->setViewCamera(lowLodCam);
+	otherWorld->setViewCamera(lowLodCam);
 	//Update visible geometry
 	forceVisualUpdate = true;
 	//Set correct scene
@@ -186,6 +207,7 @@ Game::~Game() {
 			delete gateLights[i];
 		}
 	}
+	Model::clearPrototypes();
 }
 
 void Game::keyEvent(GLFWwindow* window, int key, int scancode, int action, int mods) {
@@ -193,7 +215,7 @@ void Game::keyEvent(GLFWwindow* window, int key, int scancode, int action, int m
 }
 
 void Game::update(double dt) {
-	glm::vec3 oldPos = worldPos;
+	glm::dvec3 oldPos = worldPos;
 	glm::quat oldRot = player->getShip()->getRotation();
 	player->update(dt);
 	if (dialState > 0 && dialState < DIAL_STAGE_STOP_MOVE) {
@@ -240,7 +262,7 @@ void Game::update(double dt) {
 			}
 		}
 	} else if(dialState == 0) {
-		glm::vec3 p = gate->getGlobalPosition() - worldPos + oldPos;
+		glm::vec3 p = gate->getGlobalPosition() - glm::vec3(worldPos - oldPos);
 		float dist = glm::dot(p, p);
 		player->canDialGate = dist < DIAL_DISTANCE * DIAL_DISTANCE;
 		//Prevent collisions with gate
@@ -251,7 +273,7 @@ void Game::update(double dt) {
 		}
 	}
 	if (!inFirstScene && dialState == DIAL_STAGE_STOP_MOVE) {
-		glm::vec3 p = gate->getGlobalPosition() - worldPos + oldPos;
+		glm::vec3 p = gate->getGlobalPosition() - glm::vec3(worldPos - oldPos);
 		float dist = glm::dot(p, p);
 		if (dist < COLLIDE_DISTANCE * COLLIDE_DISTANCE) {
 			player->collideWarning = WARNING_TIME;
@@ -260,16 +282,28 @@ void Game::update(double dt) {
 		}
 	}
 	Planet* p = inFirstScene ? homeWorld : otherWorld;
-	lowLodScene->skyAmount = 1.0f - glm::clamp((glm::length(worldPos) - p->planetScale - ATMOS_MIN) / (ATMOS_MAX - ATMOS_MIN), 0.0f, 1.0f);
-	lowLodScene->skyAmount *= glm::clamp(glm::dot(glm::normalize(worldPos), glm::vec3(0.0f, 1.0f, 0.0f)) + 0.9f, 0.0f, 1.0f);
+	//Anything behind the current planet can't be seen
+	scene->setOccluder(transformedSpace, p->getOccluderRadius());
+	lowLodScene->setOccluder(lowLodScene, p->getOccluderRadius() * lowLodScale);
+	float altitude = static_cast<float>(glm::length(worldPos));
+	lowLodScene->skyAmount = 1.0f - glm::clamp((altitude - p->planetScale - ATMOS_MIN) / (ATMOS_MAX - ATMOS_MIN), 0.0f, 1.0f);
+	lowLodScene->skyAmount *= glm::clamp(glm::dot(glm::vec3(glm::normalize(worldPos)), glm::vec3(0.0f, 1.0f, 0.0f)) + 0.9f, 0.0f, 1.0f);
 	//Handle movement
 	if (forceVisualUpdate || oldPos != worldPos) {
-		p->updateVisible(transformedSpace, lowLodScene, worldPos, highPoly);
+		p->updateVisible(transformedSpace, lowLodScene, glm::vec3(worldPos), highPoly);
+		if (forceVisualUpdate) {
+			//Nothing is shown yet after loading or changing planet, so build it all at once
+			p->updateTransitions(transformedSpace, lowLodScene, highPoly, true);
+		}
 		forceVisualUpdate = false;
+		//Only the offset of transformedSpace changes, its contents are shifted in double precision
 		transformedSpace->setPosition(-worldPos);
+	} else {
+		//Carry on with LOD changes that didn't fit in previous frames
+		p->updateTransitions(transformedSpace, lowLodScene, highPoly);
 	}
 	if (oldPos != worldPos || oldRot != player->getShip()->getRotation()) {
-		float h = glm::dot(worldPos, worldPos);
+		double h = glm::dot(worldPos, worldPos);
 		if (h < (ATMOS_MIN + p->planetScale) * (ATMOS_MIN + p->planetScale)) {
 			player->setMaxSpeed(1);
 		} else if (h < (ATMOS_MAX + p->planetScale) * (ATMOS_MAX + p->planetScale)) {
@@ -278,7 +312,8 @@ void Game::update(double dt) {
 			player->setMaxSpeed(4);
 		}
 		for (Mesh* m : highPoly) {
-			if (player->getShip()->collides(m->collisionTree, m->getGlobalMatrix())) {
+			//Chunks that were just built may not have their octrees yet
+			if (m->collisionTree && player->getShip()->collides(m->collisionTree, m->getGlobalMatrix())) {
 				worldPos = oldPos;
 				transformedSpace->setPosition(-worldPos);
 				player->getShip()->setRotation(oldRot);
@@ -294,11 +329,28 @@ void Game::draw() {
 	Camera* cam = player->getActiveCamera();
 	if (!cam) { return; }
 	lowLodCam->setLocalMatrix(cam->getGlobalMatrix());
-	lowLodCam->setPosition(worldPos * lowLodScale);
+	lowLodCam->setPosition(worldPos * static_cast<double>(lowLodScale));
+	//Bring every global matrix up to date in one pass, rather than one object at a time while drawing
+	TransformSystem::update();
+	GLState::resetCounts();
+	Camera::beginFrame();
 	lowLodCam->render();
 	cam->render();
 }
 
+void Game::resize(int width, int height) {
+	if (width < 1 || height < 1) {
+		return;
+	}
+	if (player) {
+		player->resize(width, height);
+	}
+	lowLodCam->setWidth(static_cast<float>(width));
+	lowLodCam->setHeight(static_cast<float>(height));
+	//Terrain error on screen depends on the size of the view
+	forceVisualUpdate = true;
+}
+
 void Game::dialGate() {
 	if (dialState == 0) {
 		dialState = 1;
@@ -317,10 +369,11 @@ void Game::enterGate() {
 	//Move player to correct location
 	float dif = glm::length(player->getShip()->getGlobalPosition() - gate->getGlobalPosition());
 	player->getShip()->setRotation(-portal->exitPortal->getRotation() * glm::vec3(0.0f, 0.0f, glm::half_pi<float>()));
-	worldPos = portal->exitPortal->getGlobalPosition() / lowLodScale - player->getShip()->getFront() * dif;
+	glm::dvec3 exitPos = portal->exitPortal->getPreciseGlobalPosition() / static_cast<double>(lowLodScale);
+	worldPos = exitPos - glm::dvec3(player->getShip()->getFront() * dif);
 	//Rotate gate
 	gate->setRotation(-portal->exitPortal->getRotation());
-	gate->setPosition(portal->exitPortal->getGlobalPosition() / lowLodScale);
+	gate->setPosition(exitPos);
 	//Clean up gate
 	SceneObject* null = NULL;
 	portal->portalSurface->setParent(null);
@@ -17,14 +17,18 @@ public:
 	void keyEvent(GLFWwindow* window, int key, int scancode, int action, int mods);
 	void update(double dt);
 	void draw();
+	// Updates camera sizes after the window is resized
+	void resize(int width, int height);
 	void dialGate();
 	void enterGate();
-	glm::vec3 worldPos;
+	//Position of the ship, kept in double precision so it stays stable far from the origin
+	glm::dvec3 worldPos;
 	const float lowLodScale = 1.0f/1000.0f;
 	Model* gate;
 private:
 	Planet* homeWorld;
 	Planet* otherWorld;
+	ChunkResidency* terrainResidency;
 	Portal* portal;
 	Camera* lowLodCam;
 	Scene* lowLodScene;
@@ -101,8 +101,6 @@ Player::Player() {
 	orbital->setNear(0.1f);
 	orbital->setFar(4000.0f);
 	orbital->clearOnDraw = false;
-	orbital->orthosize = 50.0f;
-	orbital->recalcShadowProj();
 	forceCockpit = false;
 	canMove = true;
 	canDialGate = false;
@@ -235,6 +233,13 @@ void Player::keyEvent(GLFWwindow* window, int key, int scancode, int action, int
 	}
 }
 
+void Player::resize(int width, int height) {
+	cockpit->setWidth(static_cast<float>(width));
+	cockpit->setHeight(static_cast<float>(height));
+	orbital->setWidth(static_cast<float>(width));
+	orbital->setHeight(static_cast<float>(height));
+}
+
 void Player::setGame(Game* g) {
 	game = g;
 	if (game) {
@@ -18,6 +18,8 @@ public:
 		return ship;
 	};
 	Camera* getActiveCamera();
+	// Updates the size of the player's cameras
+	void resize(int width, int height);
 	void setMaxSpeed(int speed);
 	bool canMove;
 	bool forceCockpit;
@@ -1,6 +1,7 @@
 #include <iostream>
 
 #include "renderer\OpenGLSetup.h"
+#include "renderer\GLState.h"
 #include "renderer\Scene.h"
 #include "renderer\SceneObject.h"
 #include "renderer\Cube.h"
@@ -27,8 +28,10 @@ int newCamH = 0;
 void windowResized(GLFWwindow* window, int width, int height) {
 	newCamW = width;
 	newCamH = height;
-	glViewport(0, 0, width, height);
-//	assert(false); //PROPAGATE UPDATED CAMERA DIMENSIONS
+	GLState::setViewport(0, 0, width, height);
+	if (game) {
+		game->resize(width, height);
+	}
 }
 
 void keyEvent(GLFWwindow* window, int key, int scancode, int action, int mods) {
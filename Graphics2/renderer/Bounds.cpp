@@ -0,0 +1,41 @@
+#include "Bounds.h"
+#include <cfloat>
+
+AABB::AABB() {
+	min = glm::vec3(FLT_MAX);
+	max = glm::vec3(-FLT_MAX);
+}
+
+AABB::AABB(glm::vec3 min, glm::vec3 max) {
+	this->min = min;
+	this->max = max;
+}
+
+void AABB::expand(glm::vec3 p) {
+	min = glm::min(min, p);
+	max = glm::max(max, p);
+}
+
+void AABB::expand(const AABB& other) {
+	if (other.isEmpty()) {
+		return;
+	}
+	min = glm::min(min, other.min);
+	max = glm::max(max, other.max);
+}
+
+AABB AABB::transform(const glm::mat4& m) const {
+	if (isEmpty()) {
+		return AABB();
+	}
+	//Transform the centre, and project the extents onto each new axis (Arvo's method)
+	glm::vec3 centre = glm::vec3(m * glm::vec4(getCentre(), 1.0f));
+	glm::vec3 extents = getExtents();
+	glm::vec3 newExtents = glm::vec3(0.0f);
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < 3; j++) {
+			newExtents[i] += glm::abs(m[j][i]) * extents[j];
+		}
+	}
+	return AABB(centre - newExtents, centre + newExtents);
+}
@@ -0,0 +1,26 @@
+#pragma once
+/*
+Axis aligned bounding boxes, used to skip drawing things that can't be seen
+*/
+#include "glm/glm.hpp"
+
+class AABB {
+public:
+	// Creates an empty box (one that contains nothing)
+	AABB();
+	AABB(glm::vec3 min, glm::vec3 max);
+	// Grows the box to contain the point
+	void expand(glm::vec3 p);
+	// Grows the box to contain another box
+	void expand(const AABB& other);
+	// Whether nothing has been added to the box
+	bool isEmpty() const { return min.x > max.x; };
+	// Gets the centre of the box
+	glm::vec3 getCentre() const { return (min + max) * 0.5f; };
+	// Gets half the size of the box
+	glm::vec3 getExtents() const { return (max - min) * 0.5f; };
+	// Gets the box containing this box after it is transformed by m
+	AABB transform(const glm::mat4& m) const;
+	glm::vec3 min;
+	glm::vec3 max;
+};
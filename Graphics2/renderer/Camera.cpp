@@ -4,7 +4,12 @@
 #include "glm/gtc/matrix_inverse.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 #include "Scene.h"
+#include "GLState.h"
+#include "MeshArena.h"
 #include <iostream>
+#include <algorithm>
+
+unsigned int Camera::frame = 0;
 
 Camera::Camera() {
 	fov = glm::pi<float>() / 3.0f;
@@ -19,44 +24,20 @@ Camera::Camera() {
 	if (height < 1) { height = 1; };
 	proj = glm::perspective(fov, width / height, near, far);
 	clearOnDraw = true;
+	frustumCulling = true;
+	horizonCulling = true;
+	occlusionCulling = true;
+	maxOccluders = 8;
+	occludedCount = 0;
+	drawCount = 0;
+	culledCount = 0;
 	updateFlag = false;
-	shadow = Shader("shaders/shadow.vert", "shaders/shadow.frag");
-	glViewport(0, 0, shadowMapSize, shadowMapSize);
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-	glClear(GL_DEPTH_BUFFER_BIT);
-	initShadowMap();
 }
 
 
 Camera::~Camera() {
 }
 
-void Camera::initShadowMap() {
-	//Generate buffers
-	glGenFramebuffers(1, &fbo);
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-	glGenTextures(1, &depthMap);
-	//Setup depth map texture
-	glBindTexture(GL_TEXTURE_2D, depthMap);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, shadowMapSize, shadowMapSize, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-	float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-	//Create framebuffer
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
-	glDrawBuffer(GL_NONE);
-	glReadBuffer(GL_NONE);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	recalcShadowProj();
-}
-
-void Camera::recalcShadowProj() {
-	lightProjection = glm::ortho(-orthosize, orthosize, -orthosize, orthosize, near_plane, far_plane);
-}
-
 void Camera::setFOV(GLfloat fov) {
 	this->fov = fov;
 	updateFlag = true;
@@ -99,6 +80,28 @@ glm::mat4 Camera::getProjection() {
 	return proj;
 }
 
+void Camera::renderOccluders() {
+	glm::vec3 pos = getGlobalPosition();
+	//Rank by apparent size, only the largest few are worth drawing
+	std::vector<std::pair<float, Renderable*>> ranked;
+	for (Renderable* r : candidates) {
+		if (!r->occluder || !r->hasBounds()) {
+			continue;
+		}
+		const AABB& b = r->getWorldBounds();
+		float radius = glm::length(b.getExtents());
+		float dist = glm::max(glm::length(b.getCentre() - pos), radius);
+		ranked.push_back(std::make_pair(radius / dist, r));
+	}
+	size_t count = glm::min(ranked.size(), static_cast<size_t>(glm::max(maxOccluders, 0)));
+	std::partial_sort(ranked.begin(), ranked.begin() + count, ranked.end(),
+		[](const std::pair<float, Renderable*>& a, const std::pair<float, Renderable*>& b) { return a.first > b.first; });
+	occlusion.clear(getProjection() * getView());
+	for (size_t i = 0; i < count; i++) {
+		ranked[i].second->rasterizeOccluder(occlusion);
+	}
+}
+
 glm::mat4 Camera::getView() {
 	return glm::affineInverse(getGlobalMatrix());
 }
@@ -108,49 +111,85 @@ void Camera::render(GLuint target) {
 		std::cerr << "No scene associated with camera" << std::endl;
 		return;
 	}
-	glBindFramebuffer(GL_FRAMEBUFFER, target);
-	glEnable(GL_DEPTH_TEST);
-	glDepthFunc(GL_LESS);
-	set<Renderable*> renderables = getScene()->getRenderables();
-	//Directional lighting shadows
+	GLState::setDepthTest(true);
+	GLState::setDepthFunc(GL_LESS);
+	const set<Renderable*>& renderables = getScene()->getRenderables();
+	//Directional lighting shadows, shared with any other camera drawing the scene this frame
 	DirectionalLight* d = getScene()->getDirectionalLight();
-	//This needs changing for larger scenes
-	//Calculate directional light projection
-	glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f);
-	if (d->direction.x == 0.0 && d->direction.z == 0.0) {
-		up = glm::vec3(1.0f, 0.0f, 0.0f);
+	if (d) {
+		d->renderShadows(this, frustumCulling);
 	}
-	glm::mat4 lightView = glm::lookAt(d->direction * (far_plane - near_plane) * -0.5f,
-		glm::vec3(0.0f, 0.0f, 0.0f),
-		up);
-	glm::mat4 LSM = lightProjection * lightView;
-	//Pass matrix to shader
-	glUseProgram(shadow.getProgram());
-	glUniformMatrix4fv(glGetUniformLocation(shadow.getProgram(), "lightSpaceMatrix"), 1, false, &LSM[0][0]);
-	//Enable correct buffer
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-	glViewport(0, 0, shadowMapSize, shadowMapSize);
-	glClear(GL_DEPTH_BUFFER_BIT);
-	glCullFace(GL_NONE);
-	//Draw shadows
-	for (Renderable* r : renderables) {
-		r->renderShadow(shadow.getProgram());
-	}
-	glBindFramebuffer(GL_FRAMEBUFFER, target);
-	glCullFace(GL_BACK);
+	GLState::bindFramebuffer(target);
+	GLState::setCulling(true, GL_BACK);
 	//Reset buffer
 	//Fix viewport
 	int w, h;
 	glfwGetWindowSize(OpenGLSetup::window, &w, &h);
-	glViewport(0, 0, w, h);
+	GLState::setViewport(0, 0, w, h);
 	if (clearOnDraw) {
 		glClearColor(0.0, 0.0, 0.0, 1.0);
 		glClear(GL_COLOR_BUFFER_BIT);
 	}
 	glClear(GL_DEPTH_BUFFER_BIT);
-	//Render normally
+	//Render normally, skipping anything outside the view or behind the horizon
+	Frustum viewFrustum = frustumCulling ? Frustum(getProjection() * getView()) : Frustum();
+	Horizon horizon = horizonCulling ? getScene()->getHorizon(getGlobalPosition()) : Horizon();
+	getScene()->cullLights(viewFrustum, horizon);
+	getScene()->updateLights();
+	//Bin the lights that can be seen into clusters of this view, so each fragment only looks at its own
+	clusters.setLights(getScene()->getVisiblePointLights(), getScene()->getVisibleSpotLights());
+	clusters.build(getView(), getProjection(), near, far, static_cast<float>(w), static_cast<float>(h));
+	clusters.upload();
+	clusters.bind();
+	drawCount = 0;
+	culledCount = 0;
+	occludedCount = 0;
+	candidates.clear();
 	for (Renderable* r : renderables) {
-		r->render(this, depthMap, LSM);
+		if (!r->isVisible()) {
+			continue;
+		}
+		if (frustumCulling && !r->inFrustum(viewFrustum)) {
+			culledCount++;
+			continue;
+		}
+		if (horizonCulling && r->hasBounds()) {
+			const AABB& b = r->getWorldBounds();
+			if (horizon.isHidden(b.getCentre(), glm::length(b.getExtents()))) {
+				culledCount++;
+				continue;
+			}
+		}
+		candidates.push_back(r);
+	}
+	//Draw the biggest occluders into the software depth buffer, then skip anything behind them
+	if (occlusionCulling) {
+		renderOccluders();
+	}
+	glm::vec3 pos = getGlobalPosition();
+	queue.clear();
+	for (Renderable* r : candidates) {
+		if (occlusionCulling && r->hasBounds() && !occlusion.isVisible(r->getWorldBounds())) {
+			occludedCount++;
+			continue;
+		}
+		glm::vec3 centre = r->hasBounds() ? r->getWorldBounds().getCentre() : r->getGlobalPosition();
+		queue.submit(r->getSortKey(RenderQueue::getDepthBucket(glm::distance(pos, centre), far)), r);
+	}
+	//Group draws by state, nearest first within each group
+	queue.sort();
+	bool flushed = false;
+	for (const RenderQueue::Item& item : queue.getItems()) {
+		//Meshes in arenas only queue themselves, so draw them before any later pass can change the target
+		if (!flushed && RenderQueue::getPass(item.key) != RenderQueue::OPAQUE_PASS) {
+			MeshArena::flushAll(this);
+			flushed = true;
+		}
+		item.renderable->render(this);
+		drawCount++;
+	}
+	if (!flushed) {
+		MeshArena::flushAll(this);
 	}
 	//Lastly, render the skybox
 	this->getScene()->renderSkybox(this);
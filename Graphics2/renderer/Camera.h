@@ -5,6 +5,13 @@ Cameras draw the scenes
 #include "SceneObject.h"
 #include "OpenGLSetup.h"
 #include "Shader.h"
+#include "OcclusionBuffer.h"
+#include "RenderQueue.h"
+#include "LightClusters.h"
+#include <vector>
+
+class Renderable;
+
 class Camera :
 	public SceneObject {
 public:
@@ -42,13 +49,26 @@ public:
 	bool clearOnDraw;
 	// Renders the scene from the perspective of this camera
 	void render(GLuint target = 0);
-	// Initialises the shadow map
-	void initShadowMap();
-	// Shadow camera size
-	float near_plane = 1.0f, far_plane = 51.0f;
-	float orthosize = 7.0f;
-	// Recalculates the shawow projection
-	void recalcShadowProj();
+	// Starts a new frame, each scene's shadows are drawn by the first camera to render it after this
+	static void beginFrame() { frame++; };
+	// Gets the number of frames started
+	static unsigned int getFrame() { return frame; };
+	// Whether renderables outside the view (or the light's view for shadows) are skipped
+	bool frustumCulling;
+	// Whether renderables and lights hidden behind the scene's occluder are skipped
+	bool horizonCulling;
+	// Whether renderables hidden behind occluders (in a software depth buffer) are skipped
+	bool occlusionCulling;
+	// The most occluders drawn into the depth buffer each render
+	int maxOccluders;
+	// Gets the number of renderables drawn or culled in the last render
+	unsigned int getDrawCount() const { return drawCount; };
+	unsigned int getCulledCount() const { return culledCount; };
+	unsigned int getOccludedCount() const { return occludedCount; };
+	// Gets the software depth buffer used for occlusion culling
+	const OcclusionBuffer& getOcclusionBuffer() const { return occlusion; };
+	// Gets the lights binned into the camera's view in the last render
+	LightClusters& getClusters() { return clusters; };
 private:
 	GLfloat width;
 	GLfloat height;
@@ -58,9 +78,16 @@ private:
 	bool perspective;
 	glm::mat4 proj;
 	bool updateFlag;
-	GLuint depthMap;
-	Shader shadow;
-	unsigned int shadowMapSize = 2048;
-	GLuint fbo;
-	glm::mat4 lightProjection;
+	unsigned int drawCount;
+	unsigned int culledCount;
+	unsigned int occludedCount;
+	//Renderables that passed frustum and horizon culling this render
+	std::vector<Renderable*> candidates;
+	//Draws that passed every test, sorted to keep state changes down
+	RenderQueue queue;
+	OcclusionBuffer occlusion;
+	//Point and spot lights, binned into the view each render
+	LightClusters clusters;
+	static unsigned int frame;
+	void renderOccluders();
 };
@@ -1,4 +1,5 @@
 #include "Cube.h"
+#include "GLState.h"
 
 //Shamelessly lifted from learnopengl.com
 float cubeVertices[] = {
@@ -56,7 +57,8 @@ Cube::Cube() {
 		vertices.push_back(cubeVertices[i * 8 + 1]);
 		vertices.push_back(cubeVertices[i * 8 + 2]);
 	}
-	glBindVertexArray(vertexArray);
+	setLocalBounds(AABB(glm::vec3(-0.5f), glm::vec3(0.5f)));
+	GLState::bindVertexArray(vertexArray);
 	//Pass vertices
 	glEnableVertexAttribArray(0);
 	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
@@ -66,18 +68,18 @@ Cube::Cube() {
 
 Cube::~Cube() {
 	glDeleteBuffers(1, &vertexBuffer);
-	glDeleteVertexArrays(1, &vertexArray);
+	GLState::deleteVertexArray(vertexArray);
 }
 
-void Cube::render(Camera* cam, GLuint depthMap, glm::mat4& LSM) {
+void Cube::render(Camera* cam) {
 	//Use correct shaders
-	glUseProgram(shader.getProgram());
+	GLState::useProgram(shader.getProgram());
 	//Enable the VAO
-	glBindVertexArray(vertexArray);
+	GLState::bindVertexArray(vertexArray);
 	//Pass matrices to shader
-	glUniformMatrix4fv(glGetUniformLocation(shader.getProgram(), "model"), 1, false, &(this->getGlobalMatrix())[0][0]);
-	glUniformMatrix4fv(glGetUniformLocation(shader.getProgram(), "view"), 1, false, &(cam->getView())[0][0]);
-	glUniformMatrix4fv(glGetUniformLocation(shader.getProgram(), "projection"), 1, false, &(cam->getProjection())[0][0]);
+	glUniformMatrix4fv(shader.getUniform(Shader::MODEL), 1, false, &(this->getGlobalMatrix())[0][0]);
+	glUniformMatrix4fv(shader.getUniform(Shader::VIEW), 1, false, &(cam->getView())[0][0]);
+	glUniformMatrix4fv(shader.getUniform(Shader::PROJECTION), 1, false, &(cam->getProjection())[0][0]);
 	//Draw the VAO
 	glDrawArrays(GL_TRIANGLES, 0, vertices.size() / 3);
 }
@@ -8,7 +8,7 @@ class Cube :
 public:
 	Cube();
 	~Cube();
-	void render(Camera* cam, GLuint depthMap, glm::mat4& LSM);
+	void render(Camera* cam);
 	void renderShadow(GLuint p) {};
 private:
 	std::vector<GLfloat> vertices;
@@ -1,10 +1,10 @@
 #include "DirectionalLight.h"
 #include "Scene.h"
-/*
-IMPORTANT: Change shadows to be CSM so as to handle large scenes
-*/
+#include "Camera.h"
 
 DirectionalLight::DirectionalLight() {
+	shadowFrame = 0;
+	shadowsDrawn = false;
 }
 
 DirectionalLight::~DirectionalLight() {
@@ -21,3 +21,12 @@ void DirectionalLight::setScene(Scene* s) {
 		s->dirLight = this;
 	}
 }
+
+void DirectionalLight::renderShadows(Camera* cam, bool cull) {
+	if (shadowsDrawn && shadowFrame == Camera::getFrame()) {
+		return;
+	}
+	shadows.render(cam, getScene(), direction, cull);
+	shadowFrame = Camera::getFrame();
+	shadowsDrawn = true;
+}
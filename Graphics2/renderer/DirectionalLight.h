@@ -1,11 +1,21 @@
 #pragma once
 #include "Light.h"
+#include "ShadowMap.h"
 class DirectionalLight :
 	public Light {
 public:
 	DirectionalLight();
 	~DirectionalLight();
 	void setScene(Scene* s);
+	// Draws the light's shadows, fitted to cam's view, unless they were already drawn this frame
+	// Every camera drawing the scene shares them, see Camera::beginFrame
+	void renderShadows(Camera* cam, bool cull);
+	// Gets the light's shadow cascades
+	ShadowMap& getShadowMap() { return shadows; };
 	glm::vec3 direction;
+private:
+	ShadowMap shadows;
+	//Frame the shadows were last drawn in
+	unsigned int shadowFrame;
+	bool shadowsDrawn;
 };
-
@@ -0,0 +1,50 @@
+#include "Frustum.h"
+
+Frustum::Frustum() {
+	//Planes that accept everything
+	for (int i = 0; i < 6; i++) {
+		planes[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	}
+}
+
+Frustum::Frustum(const glm::mat4& viewProj) {
+	//Gribb/Hartmann plane extraction, glm is column major so rows are built by hand
+	glm::vec4 row0 = glm::vec4(viewProj[0][0], viewProj[1][0], viewProj[2][0], viewProj[3][0]);
+	glm::vec4 row1 = glm::vec4(viewProj[0][1], viewProj[1][1], viewProj[2][1], viewProj[3][1]);
+	glm::vec4 row2 = glm::vec4(viewProj[0][2], viewProj[1][2], viewProj[2][2], viewProj[3][2]);
+	glm::vec4 row3 = glm::vec4(viewProj[0][3], viewProj[1][3], viewProj[2][3], viewProj[3][3]);
+	planes[0] = row3 + row0;
+	planes[1] = row3 - row0;
+	planes[2] = row3 + row1;
+	planes[3] = row3 - row1;
+	planes[4] = row3 + row2;
+	planes[5] = row3 - row2;
+	for (int i = 0; i < 6; i++) {
+		float len = glm::length(glm::vec3(planes[i]));
+		if (len > 0.0f) {
+			planes[i] /= len;
+		}
+	}
+}
+
+bool Frustum::intersectsSphere(const glm::vec3& centre, float radius) const {
+	for (int i = 0; i < 6; i++) {
+		if (glm::dot(glm::vec3(planes[i]), centre) + planes[i].w < -radius) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool Frustum::intersectsBox(const AABB& box) const {
+	for (int i = 0; i < 6; i++) {
+		//Test the corner furthest along the plane's normal
+		glm::vec3 p = glm::vec3(planes[i].x > 0.0f ? box.max.x : box.min.x,
+			planes[i].y > 0.0f ? box.max.y : box.min.y,
+			planes[i].z > 0.0f ? box.max.z : box.min.z);
+		if (glm::dot(glm::vec3(planes[i]), p) + planes[i].w < 0.0f) {
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,22 @@
+#pragma once
+/*
+A view frustum, stored as six planes extracted from a view-projection matrix.
+Used to cull things that can't be seen before any work is done on them.
+*/
+#include "glm/glm.hpp"
+#include "Bounds.h"
+
+class Frustum {
+public:
+	Frustum();
+	// Extracts the planes from a combined projection * view (* model) matrix
+	Frustum(const glm::mat4& viewProj);
+	// Checks if a sphere is at least partly inside the frustum
+	bool intersectsSphere(const glm::vec3& centre, float radius) const;
+	// Checks if a box is at least partly inside the frustum
+	bool intersectsBox(const AABB& box) const;
+private:
+	//Left, right, bottom, top, near, far
+	//Normals point inwards, and are normalised so distances are correct
+	glm::vec4 planes[6];
+};
@@ -0,0 +1,179 @@
+#include "GLState.h"
+
+//Cached values are set to this when the real state isn't known
+#define UNKNOWN 0xFFFFFFFF
+
+GLuint GLState::program = UNKNOWN;
+GLuint GLState::vertexArray = UNKNOWN;
+GLuint GLState::framebuffer = UNKNOWN;
+GLuint GLState::activeUnit = UNKNOWN;
+GLuint GLState::textures[GL_STATE_TEXTURE_UNITS][4];
+GLint GLState::viewport[4] = { -1, -1, -1, -1 };
+int GLState::depthTest = -1;
+GLenum GLState::depthFunc = UNKNOWN;
+int GLState::depthMask = -1;
+int GLState::culling = -1;
+GLenum GLState::cullFace = UNKNOWN;
+unsigned int GLState::calls = 0;
+unsigned int GLState::elided = 0;
+
+template<typename T>
+bool GLState::change(T& cached, T value) {
+	if (cached == value) {
+		elided++;
+		return false;
+	}
+	cached = value;
+	calls++;
+	return true;
+}
+
+void GLState::useProgram(GLuint program) {
+	if (change(GLState::program, program)) {
+		glUseProgram(program);
+	}
+}
+
+void GLState::bindVertexArray(GLuint vertexArray) {
+	if (change(GLState::vertexArray, vertexArray)) {
+		glBindVertexArray(vertexArray);
+	}
+}
+
+void GLState::bindTexture(GLuint unit, GLenum target, GLuint texture) {
+	int slot = getTargetSlot(target);
+	if (unit >= GL_STATE_TEXTURE_UNITS || slot < 0) {
+		//Not tracked, so the active unit is no longer known either
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(target, texture);
+		activeUnit = UNKNOWN;
+		calls += 2;
+		return;
+	}
+	if (!change(textures[unit][slot], texture)) {
+		return;
+	}
+	//Only counted as a call when it is actually made
+	if (activeUnit != unit) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		activeUnit = unit;
+		calls++;
+	}
+	glBindTexture(target, texture);
+}
+
+void GLState::bindFramebuffer(GLuint framebuffer) {
+	if (change(GLState::framebuffer, framebuffer)) {
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	}
+}
+
+void GLState::setViewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+	if (viewport[0] == x && viewport[1] == y && viewport[2] == width && viewport[3] == height) {
+		elided++;
+		return;
+	}
+	viewport[0] = x;
+	viewport[1] = y;
+	viewport[2] = width;
+	viewport[3] = height;
+	calls++;
+	glViewport(x, y, width, height);
+}
+
+void GLState::setDepthTest(bool enabled) {
+	if (change(depthTest, enabled ? 1 : 0)) {
+		if (enabled) {
+			glEnable(GL_DEPTH_TEST);
+		} else {
+			glDisable(GL_DEPTH_TEST);
+		}
+	}
+}
+
+void GLState::setDepthFunc(GLenum func) {
+	if (change(depthFunc, func)) {
+		glDepthFunc(func);
+	}
+}
+
+void GLState::setDepthMask(bool write) {
+	if (change(depthMask, write ? 1 : 0)) {
+		glDepthMask(write ? GL_TRUE : GL_FALSE);
+	}
+}
+
+void GLState::setCulling(bool enabled, GLenum face) {
+	if (change(culling, enabled ? 1 : 0)) {
+		if (enabled) {
+			glEnable(GL_CULL_FACE);
+		} else {
+			glDisable(GL_CULL_FACE);
+		}
+	}
+	//The face is kept while culling is off, so it only needs setting when it is used
+	if (enabled && change(cullFace, face)) {
+		glCullFace(face);
+	}
+}
+
+void GLState::deleteVertexArray(GLuint& vertexArray) {
+	if (GLState::vertexArray == vertexArray) {
+		//Deleting the bound vertex array binds 0 instead
+		GLState::vertexArray = 0;
+	}
+	glDeleteVertexArrays(1, &vertexArray);
+	vertexArray = 0;
+}
+
+void GLState::deleteTexture(GLuint& texture) {
+	for (int u = 0; u < GL_STATE_TEXTURE_UNITS; u++) {
+		for (int t = 0; t < 4; t++) {
+			if (textures[u][t] == texture) {
+				textures[u][t] = 0;
+			}
+		}
+	}
+	glDeleteTextures(1, &texture);
+	texture = 0;
+}
+
+void GLState::invalidate() {
+	program = UNKNOWN;
+	vertexArray = UNKNOWN;
+	framebuffer = UNKNOWN;
+	activeUnit = UNKNOWN;
+	for (int u = 0; u < GL_STATE_TEXTURE_UNITS; u++) {
+		for (int t = 0; t < 4; t++) {
+			textures[u][t] = UNKNOWN;
+		}
+	}
+	for (int i = 0; i < 4; i++) {
+		viewport[i] = -1;
+	}
+	depthTest = -1;
+	depthFunc = UNKNOWN;
+	depthMask = -1;
+	culling = -1;
+	cullFace = UNKNOWN;
+}
+
+void GLState::resetCounts() {
+	calls = 0;
+	elided = 0;
+}
+
+int GLState::getTargetSlot(GLenum target) {
+	switch (target) {
+	case GL_TEXTURE_2D:
+		return 0;
+	case GL_TEXTURE_CUBE_MAP:
+		return 1;
+	case GL_TEXTURE_2D_ARRAY:
+		return 2;
+	case GL_TEXTURE_BUFFER:
+		return 3;
+	default:
+		return -1;
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+/*
+Remembers the OpenGL state set through it, so binding something that is already bound
+costs nothing. The renderer goes through this rather than calling OpenGL directly for
+programs, vertex arrays, textures, framebuffers, depth and culling state and the viewport.
+Anything that changes that state behind its back must call invalidate.
+*/
+#include "OpenGLSetup.h"
+
+//Texture units tracked, binds to higher units always go to OpenGL
+#define GL_STATE_TEXTURE_UNITS 16
+
+class GLState {
+public:
+	static void useProgram(GLuint program);
+	static void bindVertexArray(GLuint vertexArray);
+	// Binds a texture to a unit, making that unit active if it needs to change
+	static void bindTexture(GLuint unit, GLenum target, GLuint texture);
+	// Binds a framebuffer for both drawing and reading
+	static void bindFramebuffer(GLuint framebuffer);
+	static void setViewport(GLint x, GLint y, GLsizei width, GLsizei height);
+	static void setDepthTest(bool enabled);
+	static void setDepthFunc(GLenum func);
+	static void setDepthMask(bool write);
+	// Enables culling of the given face, or disables culling altogether
+	static void setCulling(bool enabled, GLenum face = GL_BACK);
+	// Deletes a vertex array or texture, forgetting it if it is bound so a new object reusing the name still gets bound
+	static void deleteVertexArray(GLuint& vertexArray);
+	static void deleteTexture(GLuint& texture);
+	// Forgets all state, so the next call of each kind always reaches OpenGL
+	static void invalidate();
+	// Gets the number of state changes sent to OpenGL since the counts were reset
+	static unsigned int getCallCount() { return calls; };
+	// Gets the number of state changes skipped because nothing would change
+	static unsigned int getElidedCount() { return elided; };
+	static void resetCounts();
+private:
+	//Returns true (and counts the call) if value differs from the cached state, updating it
+	template<typename T>
+	static bool change(T& cached, T value);
+	static int getTargetSlot(GLenum target);
+	static GLuint program;
+	static GLuint vertexArray;
+	static GLuint framebuffer;
+	static GLuint activeUnit;
+	//Texture bound to each unit, for 2D, cube map, 2D array and buffer targets
+	static GLuint textures[GL_STATE_TEXTURE_UNITS][4];
+	static GLint viewport[4];
+	static int depthTest;
+	static GLenum depthFunc;
+	static int depthMask;
+	static int culling;
+	static GLenum cullFace;
+	static unsigned int calls;
+	static unsigned int elided;
+};
@@ -0,0 +1,40 @@
+#include "Horizon.h"
+
+Horizon::Horizon() {
+	enabled = false;
+	viewPos = glm::vec3(0.0f);
+	axis = glm::vec3(0.0f, 0.0f, -1.0f);
+	sinAngle = 0.0f;
+	cosAngle = 1.0f;
+	horizonDist = 0.0f;
+}
+
+Horizon::Horizon(glm::vec3 viewPos, glm::vec3 centre, float radius) : Horizon() {
+	glm::vec3 toCentre = centre - viewPos;
+	float dist = glm::length(toCentre);
+	//Inside the occluder everything would be hidden, so don't cull at all
+	if (radius <= 0.0f || dist <= radius) {
+		return;
+	}
+	enabled = true;
+	this->viewPos = viewPos;
+	axis = toCentre / dist;
+	sinAngle = radius / dist;
+	cosAngle = static_cast<float>(sqrt(1.0f - sinAngle * sinAngle));
+	horizonDist = (dist * dist - radius * radius) / dist;
+}
+
+bool Horizon::isHidden(const glm::vec3& centre, float radius) const {
+	if (!enabled) {
+		return false;
+	}
+	glm::vec3 toCentre = centre - viewPos;
+	float along = glm::dot(toCentre, axis);
+	//Must be entirely past the horizon circle
+	if (along - radius < horizonDist) {
+		return false;
+	}
+	//And entirely inside the cone
+	float perp = glm::length(toCentre - along * axis);
+	return along * sinAngle - perp * cosAngle >= radius;
+}
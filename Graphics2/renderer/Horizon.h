@@ -0,0 +1,27 @@
+#pragma once
+/*
+Horizon culling against a sphere that blocks the view (eg the solid part of a planet).
+Anything fully inside the cone from the viewer to the sphere, and beyond the
+circle where that cone touches the sphere, can't be seen.
+*/
+#include "glm/glm.hpp"
+
+class Horizon {
+public:
+	// Creates a horizon that hides nothing
+	Horizon();
+	// Creates the horizon seen from viewPos, for an occluder at centre with the given radius
+	Horizon(glm::vec3 viewPos, glm::vec3 centre, float radius);
+	// Checks if a sphere is completely hidden behind the occluder
+	bool isHidden(const glm::vec3& centre, float radius) const;
+private:
+	bool enabled;
+	glm::vec3 viewPos;
+	//Direction from the viewer to the occluder's centre
+	glm::vec3 axis;
+	//Sine and cosine of the cone's half angle
+	float sinAngle;
+	float cosAngle;
+	//Distance along the axis to the plane of the horizon circle
+	float horizonDist;
+};
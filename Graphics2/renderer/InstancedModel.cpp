@@ -0,0 +1,125 @@
+#include "InstancedModel.h"
+#include "Mesh.h"
+#include "Scene.h"
+#include "GLState.h"
+#include <algorithm>
+
+InstancedModel::InstancedModel(const std::string& path) {
+	shader = Shader("shaders/multiLightInstanced.vert", "shaders/multiLight.frag");
+	GLState::useProgram(shader.getProgram());
+	glUniform1i(shader.getUniformLocation("shadow"), 0);
+	glUniform1i(shader.getUniformLocation("diffuse"), 1);
+	glUniform1i(shader.getUniformLocation("specular"), 2);
+	glUniform1i(shader.getUniformLocation("normalMap"), 3);
+	glUniform1i(shader.getUniformLocation("emissionMap"), 4);
+	LightClusters::setSamplers(shader);
+	glGenBuffers(1, &instanceBuffer);
+	prototype = Model::getPrototype(path);
+	if (!prototype) {
+		return;
+	}
+	for (Mesh* m : prototype->meshes) {
+		GLuint vertexArray;
+		glGenVertexArrays(1, &vertexArray);
+		GLState::bindVertexArray(vertexArray);
+		m->setupAttributes();
+		//A mat4 attribute takes four locations, one per column, and advances once per copy
+		glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+		for (int c = 0; c < 4; c++) {
+			glEnableVertexAttribArray(5 + c);
+			glVertexAttribPointer(5 + c, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(c * sizeof(glm::vec4)));
+			glVertexAttribDivisor(5 + c, 1);
+		}
+		vertexArrays.push_back(vertexArray);
+	}
+}
+
+InstancedModel::~InstancedModel() {
+	for (SceneObject* i : instances) {
+		delete i;
+	}
+	for (GLuint& v : vertexArrays) {
+		GLState::deleteVertexArray(v);
+	}
+	glDeleteBuffers(1, &instanceBuffer);
+}
+
+SceneObject* InstancedModel::addInstance() {
+	SceneObject* instance = new SceneObject();
+	instance->setParent(this);
+	instances.push_back(instance);
+	return instance;
+}
+
+void InstancedModel::removeInstance(SceneObject* instance) {
+	std::vector<SceneObject*>::iterator it = std::find(instances.begin(), instances.end(), instance);
+	if (it != instances.end()) {
+		instances.erase(it);
+		delete instance;
+	}
+}
+
+void InstancedModel::updateBounds() {
+	if (!prototype) {
+		return;
+	}
+	AABB modelBounds = prototype->getBounds();
+	glm::mat4 toLocal = glm::inverse(getGlobalMatrix());
+	AABB bounds;
+	for (SceneObject* i : instances) {
+		bounds.expand(modelBounds.transform(toLocal * i->getGlobalMatrix()));
+	}
+	setLocalBounds(bounds);
+}
+
+void InstancedModel::render(Camera* cam) {
+	if (!prototype || instances.empty()) {
+		return;
+	}
+	matrices.clear();
+	for (SceneObject* i : instances) {
+		matrices.push_back(i->getGlobalMatrix());
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	//Orphan the last draw's transforms, so the driver doesn't wait for it to finish
+	glBufferData(GL_ARRAY_BUFFER, matrices.size() * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, matrices.size() * sizeof(glm::mat4), &matrices[0]);
+	GLState::useProgram(shader.getProgram());
+	glUniformMatrix4fv(shader.getUniform(Shader::VIEW), 1, false, &(cam->getView())[0][0]);
+	glUniformMatrix4fv(shader.getUniform(Shader::PROJECTION), 1, false, &(cam->getProjection())[0][0]);
+	glUniform3fv(shader.getUniform(Shader::VIEW_POS), 1, &(cam->getGlobalPosition())[0]);
+	getScene()->bindLights();
+	cam->getClusters().bind();
+	for (size_t i = 0; i < vertexArrays.size(); i++) {
+		Mesh* m = prototype->meshes[i];
+		GLState::bindVertexArray(vertexArrays[i]);
+		m->bindMaterial(shader);
+		m->bindQuantization(shader.getProgram());
+		glUniformMatrix4fv(shader.getUniform(Shader::MODEL), 1, false, &(m->getLocalMatrix())[0][0]);
+		glDrawElementsInstanced(GL_TRIANGLES, m->getIndexCount(), GL_UNSIGNED_SHORT, 0, static_cast<GLsizei>(matrices.size()));
+	}
+}
+
+void InstancedModel::renderShadow(GLuint p) {
+	if (!prototype) {
+		return;
+	}
+	//The shadow shader isn't instanced, so each copy is drawn on its own
+	GLint model = Shader::getUniform(p, Shader::MODEL);
+	for (size_t i = 0; i < vertexArrays.size(); i++) {
+		Mesh* m = prototype->meshes[i];
+		GLState::bindVertexArray(vertexArrays[i]);
+		m->bindQuantization(p);
+		glm::mat4 local = m->getLocalMatrix();
+		for (SceneObject* instance : instances) {
+			glm::mat4 world = instance->getGlobalMatrix() * local;
+			glUniformMatrix4fv(model, 1, false, &world[0][0]);
+			glDrawElements(GL_TRIANGLES, m->getIndexCount(), GL_UNSIGNED_SHORT, 0);
+		}
+	}
+}
+
+uint64_t InstancedModel::getSortKey(unsigned int depth) {
+	GLuint vertexArray = vertexArrays.empty() ? 0 : vertexArrays[0];
+	return RenderQueue::makeKey(RenderQueue::OPAQUE_PASS, shader.getProgram(), 0, vertexArray, depth);
+}
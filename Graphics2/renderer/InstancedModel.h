@@ -0,0 +1,38 @@
+#pragma once
+/*
+Draws many copies of a model with one instanced draw per mesh.
+The copies share the model's prototype (so its buffers are only uploaded once) and
+are plain scene objects, only their transforms are sent to the GPU each draw.
+*/
+#include "Renderable.h"
+#include "Model.h"
+#include <string>
+#include <vector>
+
+class InstancedModel :
+	public Renderable {
+public:
+	InstancedModel(const std::string& path);
+	~InstancedModel();
+	// Adds a copy of the model, parented to this, move it to place the copy
+	SceneObject* addInstance();
+	// Removes and deletes a copy
+	void removeInstance(SceneObject* instance);
+	// Gets the number of copies
+	size_t getInstanceCount() const { return instances.size(); };
+	// Recalculates the bounds from the copies, call after moving them
+	void updateBounds();
+	// Draws every copy
+	void render(Camera* cam);
+	// Draws the shadows of every copy
+	void renderShadow(GLuint p);
+	uint64_t getSortKey(unsigned int depth);
+private:
+	Model* prototype;
+	std::vector<SceneObject*> instances;
+	//One per mesh of the prototype, using its buffers plus the instance buffer
+	std::vector<GLuint> vertexArrays;
+	GLuint instanceBuffer;
+	//Transforms of the copies, gathered each draw
+	std::vector<glm::mat4> matrices;
+};
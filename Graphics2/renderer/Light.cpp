@@ -1,4 +1,8 @@
 #include "Light.h"
+#include <cfloat>
+
+//Light dimmer than this can't be seen
+#define LIGHT_CUTOFF (1.0f / 256.0f)
 
 
 
@@ -8,3 +12,19 @@ Light::Light() {
 
 Light::~Light() {
 }
+
+float Light::attenuationRange(float constant, float linear, float quadratic) {
+	float brightest = glm::max(glm::max(colour.r, colour.g), colour.b);
+	//Solve constant + linear * d + quadratic * d^2 = brightest / cutoff
+	float k = constant - brightest / LIGHT_CUTOFF;
+	if (k >= 0.0f) {
+		return 0.0f;
+	}
+	if (quadratic > 0.0f) {
+		return static_cast<float>((-linear + sqrt(linear * linear - 4.0f * quadratic * k)) / (2.0f * quadratic));
+	}
+	if (linear > 0.0f) {
+		return -k / linear;
+	}
+	return FLT_MAX;
+}
@@ -7,6 +7,8 @@ public:
 	Light();
 	virtual ~Light();
 	glm::vec3 colour;
-	GLuint depthMap;
+protected:
+	//Distance at which attenuated light drops below a visible amount
+	float attenuationRange(float constant, float linear, float quadratic);
 };
 
@@ -0,0 +1,226 @@
+#include "LightClusters.h"
+#include "PointLight.h"
+#include "SpotLight.h"
+#include "GLState.h"
+#include <cmath>
+
+//Light indices are 16 bit
+#define MAX_LIGHTS 0xFFFF
+
+LightClusters* LightClusters::bound = NULL;
+
+LightClusters::LightClusters() {
+	initialised = false;
+	blockBuffer = 0;
+	for (int i = 0; i < 3; i++) {
+		buffers[i] = 0;
+		textures[i] = 0;
+		capacities[i] = 0;
+	}
+	block.view = glm::mat4(1.0f);
+	block.grid = glm::vec4(GRID_X, GRID_Y, GRID_Z, 0.0f);
+	block.params = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+}
+
+LightClusters::~LightClusters() {
+	if (bound == this) {
+		bound = NULL;
+	}
+	if (initialised) {
+		glDeleteBuffers(1, &blockBuffer);
+		glDeleteBuffers(3, buffers);
+		for (int i = 0; i < 3; i++) {
+			GLState::deleteTexture(textures[i]);
+		}
+	}
+}
+
+void LightClusters::clearLights() {
+	lightData.clear();
+	spheres.clear();
+}
+
+void LightClusters::addLight(const glm::vec3& position, const glm::vec3& colour, float constant, float linear, float quadratic,
+	float range, const glm::vec3& direction, float cutOff, float outerCutOff) {
+	if (spheres.size() >= MAX_LIGHTS) {
+		return;
+	}
+	lightData.push_back(glm::vec4(position, constant));
+	lightData.push_back(glm::vec4(colour, linear));
+	lightData.push_back(glm::vec4(direction, quadratic));
+	lightData.push_back(glm::vec4(cutOff, outerCutOff, 0.0f, 0.0f));
+	spheres.push_back(glm::vec4(position, range));
+}
+
+void LightClusters::setLights(const std::vector<PointLight*>& points, const std::vector<SpotLight*>& spots) {
+	clearLights();
+	for (PointLight* p : points) {
+		addLight(glm::vec3(p->getGlobalMatrix()[3]), p->colour, p->constant, p->linear, p->quadratic, p->getRange());
+	}
+	for (SpotLight* s : spots) {
+		glm::mat4 mat = s->getGlobalMatrix();
+		addLight(glm::vec3(mat[3]), s->colour, s->constant, s->linear, s->quadratic, s->getRange(),
+			glm::vec3(glm::mat3(mat) * s->direction), s->cutOff, s->outerCutOff);
+	}
+}
+
+int LightClusters::getSlice(float depth) const {
+	if (depth <= 0.0f) {
+		return 0;
+	}
+	int slice = static_cast<int>(std::floor(std::log(depth) * block.params.z + block.params.w));
+	return glm::clamp(slice, 0, GRID_Z - 1);
+}
+
+//Finds the tiles covered by a box from min to max across the screen, between depths d0 and d1
+//scale and offset are the projection's terms for that axis
+static bool getTileRange(float scale, float offset, float translate, bool perspective, float min, float max, float d0, float d1,
+	int tiles, int& first, int& last) {
+	float lo = 1.0f;
+	float hi = -1.0f;
+	float xs[2] = { min, max };
+	float ds[2] = { d0, d1 };
+	for (float x : xs) {
+		for (float d : ds) {
+			//View space z is -d
+			float clip = scale * x - offset * d + translate;
+			float ndc = perspective ? clip / d : clip;
+			lo = glm::min(lo, ndc);
+			hi = glm::max(hi, ndc);
+		}
+	}
+	if (hi < -1.0f || lo > 1.0f) {
+		return false;
+	}
+	first = glm::clamp(static_cast<int>(std::floor((lo * 0.5f + 0.5f) * tiles)), 0, tiles - 1);
+	last = glm::clamp(static_cast<int>(std::floor((hi * 0.5f + 0.5f) * tiles)), 0, tiles - 1);
+	return true;
+}
+
+void LightClusters::build(const glm::mat4& view, const glm::mat4& proj, float near, float far, float width, float height) {
+	near = glm::max(near, 1e-4f);
+	far = glm::max(far, near * 1.001f);
+	//Slices get deeper with distance, slice = log(depth / near) / log(far / near) * GRID_Z
+	float logRange = std::log(far / near);
+	block.view = view;
+	block.grid = glm::vec4(GRID_X, GRID_Y, GRID_Z, 0.0f);
+	block.params = glm::vec4(width, height, GRID_Z / logRange, -GRID_Z * std::log(near) / logRange);
+	bool perspective = proj[2][3] != 0.0f;
+	pairs.clear();
+	for (size_t l = 0; l < spheres.size(); l++) {
+		glm::vec3 c = glm::vec3(view * glm::vec4(glm::vec3(spheres[l]), 1.0f));
+		float r = spheres[l].w;
+		float depth = -c.z;
+		if (depth + r < near || depth - r > far) {
+			continue;
+		}
+		int z0 = getSlice(depth - r);
+		int z1 = getSlice(depth + r);
+		for (int z = z0; z <= z1; z++) {
+			//Only the part of the light's box inside this slice
+			float d0 = glm::max(depth - r, near * std::exp(logRange * z / GRID_Z));
+			float d1 = glm::min(depth + r, near * std::exp(logRange * (z + 1) / GRID_Z));
+			d0 = glm::max(d0, near);
+			if (z == GRID_Z - 1) {
+				d1 = depth + r;
+			}
+			if (d1 < d0) {
+				continue;
+			}
+			int x0, x1, y0, y1;
+			if (!getTileRange(proj[0][0], proj[2][0], proj[3][0], perspective, c.x - r, c.x + r, d0, d1, GRID_X, x0, x1) ||
+				!getTileRange(proj[1][1], proj[2][1], proj[3][1], perspective, c.y - r, c.y + r, d0, d1, GRID_Y, y0, y1)) {
+				continue;
+			}
+			for (int y = y0; y <= y1; y++) {
+				for (int x = x0; x <= x1; x++) {
+					pairs.push_back(std::make_pair(static_cast<GLuint>(getCluster(x, y, z)), static_cast<GLushort>(l)));
+				}
+			}
+		}
+	}
+	//Group the light indices by cluster (counting sort)
+	clusters.assign(CLUSTER_COUNT * 2, 0);
+	for (const std::pair<GLuint, GLushort>& p : pairs) {
+		clusters[p.first * 2 + 1]++;
+	}
+	GLuint offset = 0;
+	for (int c = 0; c < CLUSTER_COUNT; c++) {
+		clusters[c * 2] = offset;
+		offset += clusters[c * 2 + 1];
+	}
+	indices.resize(pairs.size());
+	for (const std::pair<GLuint, GLushort>& p : pairs) {
+		indices[clusters[p.first * 2]++] = p.second;
+	}
+	//Filling moved each offset to the end of its cluster
+	for (int c = 0; c < CLUSTER_COUNT; c++) {
+		clusters[c * 2] -= clusters[c * 2 + 1];
+	}
+}
+
+void LightClusters::init() {
+	static_assert(sizeof(ClusterBlock) == 96, "ClusterBlock must match the std140 layout of the Clusters block");
+	glGenBuffers(1, &blockBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, blockBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(ClusterBlock), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glGenBuffers(3, buffers);
+	glGenTextures(3, textures);
+	const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R16UI };
+	const GLuint units[3] = { LIGHT_TEXTURE_UNIT, CLUSTER_TEXTURE_UNIT, INDEX_TEXTURE_UNIT };
+	for (int i = 0; i < 3; i++) {
+		//Never empty, so the textures are always valid
+		capacities[i] = sizeof(glm::vec4);
+		glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, capacities[i], NULL, GL_STREAM_DRAW);
+		GLState::bindTexture(units[i], GL_TEXTURE_BUFFER, textures[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+	}
+	initialised = true;
+}
+
+void LightClusters::uploadBuffer(GLuint buffer, size_t& capacity, const void* data, size_t bytes) {
+	if (bytes == 0) {
+		return;
+	}
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	if (bytes > capacity) {
+		//Grow with room to spare, so a few more lights don't reallocate every frame
+		capacity = bytes * 2;
+		glBufferData(GL_TEXTURE_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+	}
+	glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+}
+
+void LightClusters::upload() {
+	if (!initialised) {
+		init();
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, blockBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(ClusterBlock), &block);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	uploadBuffer(buffers[0], capacities[0], lightData.empty() ? NULL : &lightData[0], lightData.size() * sizeof(glm::vec4));
+	uploadBuffer(buffers[1], capacities[1], clusters.empty() ? NULL : &clusters[0], clusters.size() * sizeof(GLuint));
+	uploadBuffer(buffers[2], capacities[2], indices.empty() ? NULL : &indices[0], indices.size() * sizeof(GLushort));
+}
+
+void LightClusters::bind() {
+	if (!initialised) {
+		init();
+	}
+	//The textures go through GLState, so only the block needs checking here
+	if (bound != this) {
+		glBindBufferBase(GL_UNIFORM_BUFFER, Shader::CLUSTERS_BLOCK, blockBuffer);
+		bound = this;
+	}
+	GLState::bindTexture(LIGHT_TEXTURE_UNIT, GL_TEXTURE_BUFFER, textures[0]);
+	GLState::bindTexture(CLUSTER_TEXTURE_UNIT, GL_TEXTURE_BUFFER, textures[1]);
+	GLState::bindTexture(INDEX_TEXTURE_UNIT, GL_TEXTURE_BUFFER, textures[2]);
+}
+
+void LightClusters::setSamplers(const Shader& s) {
+	glUniform1i(s.getUniformLocation("lights"), LIGHT_TEXTURE_UNIT);
+	glUniform1i(s.getUniformLocation("clusters"), CLUSTER_TEXTURE_UNIT);
+	glUniform1i(s.getUniformLocation("lightIndices"), INDEX_TEXTURE_UNIT);
+}
@@ -0,0 +1,86 @@
+#pragma once
+/*
+Clustered forward lighting.
+A camera's view is split into a grid of clusters (tiles across the screen, sliced
+exponentially by depth), and every visible point and spot light is binned into the
+clusters its range reaches. Fragments only loop over the lights of their own cluster,
+so many lights cost little more than a few as long as they don't all overlap.
+Binning uses no GL calls, so it can be run (and checked) without a context; upload
+then sends the lights, the cluster ranges and the light index list as buffer textures.
+*/
+#include "OpenGLSetup.h"
+#include "Shader.h"
+#include "glm/glm.hpp"
+#include <vector>
+
+class PointLight;
+class SpotLight;
+
+class LightClusters {
+public:
+	//Size of the cluster grid
+	enum { GRID_X = 16, GRID_Y = 9, GRID_Z = 24, CLUSTER_COUNT = GRID_X * GRID_Y * GRID_Z };
+	//Texture units the buffers are bound to (after the material and arena textures)
+	enum { LIGHT_TEXTURE_UNIT = 6, CLUSTER_TEXTURE_UNIT = 7, INDEX_TEXTURE_UNIT = 8 };
+	LightClusters();
+	~LightClusters();
+	// Packs the lights to be binned, point lights first
+	void setLights(const std::vector<PointLight*>& points, const std::vector<SpotLight*>& spots);
+	// Adds a light directly, range is how far it reaches
+	// Point lights have a cone that covers everything (cutOff -1)
+	void addLight(const glm::vec3& position, const glm::vec3& colour, float constant, float linear, float quadratic,
+		float range, const glm::vec3& direction = glm::vec3(0.0f, -1.0f, 0.0f), float cutOff = -1.0f, float outerCutOff = -2.0f);
+	// Removes every light
+	void clearLights();
+	// Bins the lights into the clusters of a view, width and height are the size of the viewport
+	void build(const glm::mat4& view, const glm::mat4& proj, float near, float far, float width, float height);
+	// Gets the number of lights reaching a cluster, and the first of them in the index list
+	GLuint getCount(int x, int y, int z) const { return clusters[getCluster(x, y, z) * 2 + 1]; };
+	GLuint getOffset(int x, int y, int z) const { return clusters[getCluster(x, y, z) * 2]; };
+	// Gets the index of a light in the order it was added
+	GLushort getIndex(GLuint i) const { return indices[i]; };
+	// Gets the number of lights and cluster entries
+	size_t getLightCount() const { return spheres.size(); };
+	size_t getIndexCount() const { return indices.size(); };
+	// Gets the depth slice a view space distance falls in
+	int getSlice(float depth) const;
+	// Sends the last build to the GPU
+	void upload();
+	// Binds the clusters for multiLight programs, does nothing if they are already bound
+	void bind();
+	// Points a multiLight program's cluster samplers at the right units (the program must be in use)
+	static void setSamplers(const Shader& s);
+private:
+	//The Clusters block of multiLight.frag, laid out std140
+	struct ClusterBlock {
+		glm::mat4 view;
+		//Clusters in x, y and z
+		glm::vec4 grid;
+		//Viewport size, then the scale and bias turning log(depth) into a slice
+		glm::vec4 params;
+	};
+	LightClusters(const LightClusters& other) = delete;
+	LightClusters& operator=(const LightClusters& other) = delete;
+	static int getCluster(int x, int y, int z) { return (z * GRID_Y + y) * GRID_X + x; };
+	//Creates the GL objects, on first upload
+	void init();
+	//Uploads data to a buffer, growing it if needed
+	static void uploadBuffer(GLuint buffer, size_t& capacity, const void* data, size_t bytes);
+	//Four texels per light, see multiLight.frag
+	std::vector<glm::vec4> lightData;
+	//World space position and range of each light
+	std::vector<glm::vec4> spheres;
+	//First index and count of each cluster
+	std::vector<GLuint> clusters;
+	std::vector<GLushort> indices;
+	//Cluster each light index belongs to, before they are grouped by cluster
+	std::vector<std::pair<GLuint, GLushort>> pairs;
+	ClusterBlock block;
+	bool initialised;
+	GLuint blockBuffer;
+	GLuint buffers[3];
+	GLuint textures[3];
+	size_t capacities[3];
+	//Clusters bound to the Clusters binding point and texture units
+	static LightClusters* bound;
+};
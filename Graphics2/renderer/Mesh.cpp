@@ -1,109 +1,244 @@
 #include "Mesh.h"
 #include "Scene.h"
+#include "GLState.h"
 
 Mesh::Mesh() {
+	useMeshShader();
+	geometrySource = NULL;
+	arena = NULL;
+	hasTangents = false;
+	positionOffset = glm::vec3(0.0f);
+	positionScale = glm::vec3(1.0f);
+	uvOffset = glm::vec2(0.0f);
+	uvScale = glm::vec2(1.0f);
+	//Buffers are made when the mesh is given geometry of its own, arena and shared meshes never need them
+	vertexArray = 0;
+	elementBuffer = 0;
+	vertexBuffer = 0;
+	GLState::useProgram(program);
+	glUniform1i(shader.getUniformLocation("shadow"), 0);
+	glUniform1i(shader.getUniformLocation("diffuse"), 1);
+	glUniform1i(shader.getUniformLocation("specular"), 2);
+	glUniform1i(shader.getUniformLocation("normalMap"), 3);
+	glUniform1i(shader.getUniformLocation("emissionMap"), 4);
+	LightClusters::setSamplers(shader);
+	shininess = 0;
+	diffuse = 0;
+	specular = 0;
+	emission = 0;
+	normal = 0;
+	updateMaterial();
+	collisionTree = nullptr;
+}
+
+Mesh::~Mesh() {
+	//Shared buffers belong to the source mesh
+	if (arena) {
+		arena->free(allocation);
+	} else if (!geometrySource) {
+		deleteBuffers();
+	}
+	if (collisionTree) {
+		delete collisionTree;
+	}
+}
+
+void Mesh::useMeshShader() {
 	shader = Shader("shaders/multiLight.vert", "shaders/multiLight.frag");
 	program = shader.getProgram();
+}
+
+void Mesh::createBuffers() {
 	glGenVertexArrays(1, &vertexArray);
 	glGenBuffers(1, &elementBuffer);
 	glGenBuffers(1, &vertexBuffer);
-	glGenBuffers(1, &uvBuffer);
-	glGenBuffers(1, &normalBuffer);
-	glGenBuffers(1, &tangentBuffer);
-	glGenBuffers(1, &bitangentBuffer);
-	glUseProgram(program);
-	glUniform1i(glGetUniformLocation(program, "shadow"), 0);
-	glUniform1i(glGetUniformLocation(program, "diffuse"), 1);
-	glUniform1i(glGetUniformLocation(program, "specular"), 2);
-	glUniform1i(glGetUniformLocation(program, "normalMap"), 3);
-	glUniform1i(glGetUniformLocation(program, "emissionMap"), 4);
-	glUseProgram(0);
-	shininess = 0;
 }
 
-Mesh::~Mesh() {
+void Mesh::deleteBuffers() {
+	if (!vertexArray) {
+		return;
+	}
 	glDeleteBuffers(1, &elementBuffer);
 	glDeleteBuffers(1, &vertexBuffer);
-	glDeleteBuffers(1, &uvBuffer);
-	glDeleteBuffers(1, &normalBuffer);
-	glDeleteBuffers(1, &tangentBuffer);
-	glDeleteBuffers(1, &bitangentBuffer);
-	glDeleteVertexArrays(1, &vertexArray);
+	GLState::deleteVertexArray(vertexArray);
+	elementBuffer = 0;
+	vertexBuffer = 0;
+}
+
+void Mesh::shareMesh(Mesh* source) {
+	if (arena) {
+		arena->free(allocation);
+		arena = NULL;
+		useMeshShader();
+	} else if (!geometrySource) {
+		deleteBuffers();
+	}
+	geometrySource = source->getGeometry();
+	indices.clear();
+	vertices.clear();
+	vertexArray = geometrySource->vertexArray;
+	elementBuffer = geometrySource->elementBuffer;
+	vertexBuffer = geometrySource->vertexBuffer;
+	setLocalBounds(source->getLocalBounds());
+	//Start with the same look, it can still be changed per mesh
+	name = source->name;
+	diffuse = source->diffuse;
+	specular = source->specular;
+	normal = source->normal;
+	emission = source->emission;
+	shininess = source->shininess;
+	useNormalTexture = source->useNormalTexture;
+	updateMaterial();
 }
 
 void Mesh::setMesh(vector<unsigned short> indices, vector<glm::vec3> vertices, vector<glm::vec2> uvs, vector<glm::vec3> normals, vector<glm::vec3> tangents, vector<glm::vec3> bitangents) {
+	if (arena) {
+		arena->free(allocation);
+		arena = NULL;
+		useMeshShader();
+		vertexArray = 0;
+	} else if (geometrySource) {
+		//Stop sharing, rather than overwriting the source's buffers
+		geometrySource = NULL;
+		vertexArray = 0;
+	}
+	if (!vertexArray) {
+		createBuffers();
+	}
 	this->indices = indices;
 	this->vertices = vertices;
-	this->uvs = uvs;
-	this->normals = normals;
-	this->tangents = tangents;
-	this->bitangents = bitangents;
+	hasTangents = tangents.size() > 0;
+	AABB bounds;
+	for (glm::vec3& v : this->vertices) {
+		bounds.expand(v);
+	}
+	setLocalBounds(bounds);
+	//Positions and UVs are stored as 16 bit fractions of their range
+	glm::vec2 uvMin = uvs.size() > 0 ? uvs[0] : glm::vec2(0.0f);
+	glm::vec2 uvMax = uvMin;
+	for (glm::vec2& uv : uvs) {
+		uvMin = glm::min(uvMin, uv);
+		uvMax = glm::max(uvMax, uv);
+	}
+	positionOffset = bounds.min;
+	positionScale = glm::vec3(VertexFormat::rangeScale(bounds.min.x, bounds.max.x),
+		VertexFormat::rangeScale(bounds.min.y, bounds.max.y),
+		VertexFormat::rangeScale(bounds.min.z, bounds.max.z));
+	uvOffset = uvMin;
+	uvScale = glm::vec2(VertexFormat::rangeScale(uvMin.x, uvMax.x), VertexFormat::rangeScale(uvMin.y, uvMax.y));
+	//Pack the vertices, only positions and indices are kept on the CPU
+	vector<GpuVertex> packed(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++) {
+		GpuVertex& v = packed[i];
+		for (int c = 0; c < 3; c++) {
+			v.position[c] = VertexFormat::quantize(vertices[i][c], positionOffset[c], positionScale[c]);
+		}
+		v.position[3] = 0;
+		glm::vec2 uv = i < uvs.size() ? uvs[i] : uvOffset;
+		v.uv[0] = VertexFormat::quantize(uv.x, uvOffset.x, uvScale.x);
+		v.uv[1] = VertexFormat::quantize(uv.y, uvOffset.y, uvScale.y);
+		glm::vec3 n = i < normals.size() ? normals[i] : glm::vec3(0.0f, 1.0f, 0.0f);
+		VertexFormat::encodeNormal(glm::normalize(n), v.normal);
+		v.tangent = 0;
+		if (hasTangents) {
+			//The bitangent is rebuilt from the normal and tangent, only which way it points is stored
+			float handedness = glm::dot(glm::cross(n, tangents[i]), bitangents[i]) < 0.0f ? -1.0f : 1.0f;
+			v.tangent = VertexFormat::packTangent(glm::normalize(tangents[i]), handedness);
+		}
+	}
+	//The element buffer is part of the VAO's state, so the VAO has to be bound first
+	GLState::bindVertexArray(vertexArray);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), &(this->indices[0]), GL_STATIC_DRAW);
-	glBindVertexArray(vertexArray);
 	//Pass vertices
-	glEnableVertexAttribArray(0);
 	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), &(this->vertices[0]), GL_STATIC_DRAW);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-	//Pass UVs
+	glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(GpuVertex), &packed[0], GL_STATIC_DRAW);
+	setupAttributes();
+}
+
+void Mesh::setMesh(MeshArena* arena, vector<unsigned short> indices, vector<glm::vec3> vertices, vector<glm::vec2> uvs, vector<glm::vec3> normals) {
+	if (this->arena) {
+		this->arena->free(allocation);
+	} else if (!geometrySource) {
+		deleteBuffers();
+	}
+	geometrySource = NULL;
+	this->arena = arena;
+	shader = arena->getShader();
+	program = shader.getProgram();
+	//Only what collisions and occlusion culling use is kept on the CPU
+	this->indices = indices;
+	this->vertices = vertices;
+	hasTangents = false;
+	AABB bounds;
+	for (glm::vec3& v : this->vertices) {
+		bounds.expand(v);
+	}
+	setLocalBounds(bounds);
+	allocation = arena->allocate(indices, vertices, uvs, normals);
+	vertexArray = allocation.page >= 0 ? arena->getVertexArray(allocation.page) : 0;
+	elementBuffer = 0;
+	vertexBuffer = 0;
+	//UVs are fractions of the arena's range
+	positionOffset = allocation.positionOffset;
+	positionScale = allocation.positionScale;
+	uvOffset = glm::vec2(0.0f);
+	uvScale = glm::vec2(arena->getUVRange());
+}
+
+void Mesh::setupAttributes() {
+	Mesh* g = getGeometry();
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g->elementBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, g->vertexBuffer);
+	//Vertices
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(GpuVertex), (void*)offsetof(GpuVertex, position));
+	//UVs
 	glEnableVertexAttribArray(1);
-	glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
-	glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(glm::vec2), &(this->uvs[0]), GL_STATIC_DRAW);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
-	//Pass normals
+	glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(GpuVertex), (void*)offsetof(GpuVertex, uv));
+	//Normals
 	glEnableVertexAttribArray(2);
-	glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-	glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), &(this->normals[0]), GL_STATIC_DRAW);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-	if (tangents.size()>0) {
-		//Pass tangents
+	glVertexAttribPointer(2, 2, GL_SHORT, GL_TRUE, sizeof(GpuVertex), (void*)offsetof(GpuVertex, normal));
+	if (g->hasTangents) {
+		//Tangents, with the bitangent's handedness in w
 		glEnableVertexAttribArray(3);
-		glBindBuffer(GL_ARRAY_BUFFER, tangentBuffer);
-		glBufferData(GL_ARRAY_BUFFER, tangents.size() * sizeof(glm::vec3), &(this->tangents[0]), GL_STATIC_DRAW);
-		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-		//Pass bitangents
-		glEnableVertexAttribArray(4);
-		glBindBuffer(GL_ARRAY_BUFFER, bitangentBuffer);
-		glBufferData(GL_ARRAY_BUFFER, bitangents.size() * sizeof(glm::vec3), &(this->bitangents[0]), GL_STATIC_DRAW);
-		glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+		glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(GpuVertex), (void*)offsetof(GpuVertex, tangent));
 	}
 }
 
-void Mesh::render(Camera* cam, GLuint depthMap, glm::mat4& LSM) {
-	//Use correct shaders
-	glUseProgram(program);
-	//Enable the VAO
-	glBindVertexArray(vertexArray);
-	//Pass texture to shaders
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, depthMap);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, diffuse);
-	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, specular);
-	glActiveTexture(GL_TEXTURE3);
-	glBindTexture(GL_TEXTURE_2D, normal);
-	glActiveTexture(GL_TEXTURE4);
-	glBindTexture(GL_TEXTURE_2D, emission);
+void Mesh::bindQuantization(GLuint p) {
+	Mesh* g = getGeometry();
+	glUniform3fv(Shader::getUniform(p, Shader::POSITION_OFFSET), 1, &g->positionOffset[0]);
+	glUniform3fv(Shader::getUniform(p, Shader::POSITION_SCALE), 1, &g->positionScale[0]);
+	glUniform2fv(Shader::getUniform(p, Shader::UV_OFFSET), 1, &g->uvOffset[0]);
+	glUniform2fv(Shader::getUniform(p, Shader::UV_SCALE), 1, &g->uvScale[0]);
+}
+
+void Mesh::bindMaterial(const Shader& s) {
+	GLState::bindTexture(1, GL_TEXTURE_2D, diffuse);
+	GLState::bindTexture(2, GL_TEXTURE_2D, specular);
+	GLState::bindTexture(3, GL_TEXTURE_2D, normal);
+	GLState::bindTexture(4, GL_TEXTURE_2D, emission);
 	//Whether or not to use the normal map
-	glUniform1i(glGetUniformLocation(program, "useNormalTexture"), useNormalTexture);
+	glUniform1i(s.getUniform(Shader::USE_NORMAL_TEXTURE), useNormalTexture);
 	//Shininess
-	glUniform1f(glGetUniformLocation(program, "shininess"), shininess);
-	//Pass matrices to shader
-	glUniformMatrix4fv(glGetUniformLocation(program, "model"), 1, false, &(this->getGlobalMatrix())[0][0]);
-	glm::mat3 inv = glm::mat3(glm::transpose(glm::inverse(this->getGlobalMatrix())));
-	glUniformMatrix3fv(glGetUniformLocation(program, "transInvModel"), 1, false, &inv[0][0]);
-	glUniformMatrix4fv(glGetUniformLocation(program, "view"), 1, false, &(cam->getView())[0][0]);
-	glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, false, &(cam->getProjection())[0][0]);
-	//Pass the camera position
-	glUniform3fv(glGetUniformLocation(program, "viewPos"), 1, &(cam->getGlobalPosition())[0]);
-	//Shadows
-	glUniformMatrix4fv(glGetUniformLocation(program, "lightSpaceMatrix"), 1, false, &LSM[0][0]);
-	//Update lighting
-	getScene()->updateLights();
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
-	glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_SHORT, 0);
+	glUniform1f(s.getUniform(Shader::SHININESS), shininess);
+}
+
+void Mesh::render(Camera* cam) {
+	if (arena) {
+		//Drawn with the rest of the arena once the opaque pass is done
+		if (allocation.page >= 0) {
+			arena->queue(this);
+		}
+		return;
+	}
+	//Nothing to draw until the mesh has geometry
+	if (!vertexArray) {
+		return;
+	}
+	bindDrawState(cam);
+	glDrawElements(GL_TRIANGLES, getIndexCount(), GL_UNSIGNED_SHORT, 0);
 
 	//if (collisionTree) {
 	//	collisionTree->draw(this->getGlobalMatrix(), cam);
@@ -111,13 +246,52 @@ void Mesh::render(Camera* cam, GLuint depthMap, glm::mat4& LSM) {
 
 }
 
+void Mesh::bindDrawState(Camera* cam) {
+	//Use correct shaders, meshes are drawn sorted so this is usually already bound
+	GLState::useProgram(program);
+	//Enable the VAO (which holds the element buffer)
+	GLState::bindVertexArray(vertexArray);
+	//Pass textures and material to shaders
+	bindMaterial(shader);
+	bindQuantization(program);
+	//Pass matrices to shader
+	glUniformMatrix4fv(shader.getUniform(Shader::MODEL), 1, false, &(this->getGlobalMatrix())[0][0]);
+	glm::mat3 inv = glm::mat3(glm::transpose(glm::inverse(this->getGlobalMatrix())));
+	glUniformMatrix3fv(shader.getUniform(Shader::TRANS_INV_MODEL), 1, false, &inv[0][0]);
+	glUniformMatrix4fv(shader.getUniform(Shader::VIEW), 1, false, &(cam->getView())[0][0]);
+	glUniformMatrix4fv(shader.getUniform(Shader::PROJECTION), 1, false, &(cam->getProjection())[0][0]);
+	//Pass the camera position
+	glUniform3fv(shader.getUniform(Shader::VIEW_POS), 1, &(cam->getGlobalPosition())[0]);
+	//Lights are uploaded once per frame by the camera, they only need binding
+	getScene()->bindLights();
+	cam->getClusters().bind();
+}
+
+uint64_t Mesh::getSortKey(unsigned int depth) {
+	return RenderQueue::makeKey(RenderQueue::OPAQUE_PASS, program, material, vertexArray, depth);
+}
+
 void Mesh::renderShadow(GLuint p) {
+	if (!vertexArray) {
+		return;
+	}
 	//Enable the VAO
-	glBindVertexArray(vertexArray);
+	GLState::bindVertexArray(vertexArray);
+	bindQuantization(p);
 	//Pass matrices to shader
-	glUniformMatrix4fv(glGetUniformLocation(p, "model"), 1, false, &(this->getGlobalMatrix())[0][0]);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
-	glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_SHORT, 0);
+	glUniformMatrix4fv(Shader::getUniform(p, Shader::MODEL), 1, false, &(this->getGlobalMatrix())[0][0]);
+	if (arena) {
+		if (allocation.page >= 0) {
+			glDrawElementsBaseVertex(GL_TRIANGLES, allocation.indexCount, GL_UNSIGNED_SHORT,
+				reinterpret_cast<const void*>(allocation.firstIndex * sizeof(unsigned short)), allocation.baseVertex);
+		}
+		return;
+	}
+	glDrawElements(GL_TRIANGLES, getIndexCount(), GL_UNSIGNED_SHORT, 0);
+}
+
+void Mesh::rasterizeOccluder(OcclusionBuffer& buffer) {
+	buffer.rasterize(getGeometry()->vertices, getGeometry()->indices, getGlobalMatrix());
 }
 
 void Mesh::setShininess(float shininess) {
@@ -126,18 +300,26 @@ void Mesh::setShininess(float shininess) {
 
 void Mesh::setDiffuse(GLuint diffuse) {
 	this->diffuse = diffuse;
+	updateMaterial();
 }
 
 void Mesh::setSpecular(GLuint specular) {
 	this->specular = specular;
+	updateMaterial();
 }
 
 void Mesh::setEmission(GLuint emission) {
 	this->emission = emission;
+	updateMaterial();
 }
 
 void Mesh::setNormal(GLuint normal) {
 	this->normal = normal;
+	updateMaterial();
+}
+
+void Mesh::updateMaterial() {
+	material = RenderQueue::getMaterialId(diffuse, specular, normal, emission);
 }
 
 void Mesh::setName(string name) {
@@ -149,11 +331,20 @@ void Mesh::setModel(Model* m) {
 }
 
 void Mesh::createOctree(int depth) {
+	setOctree(makeOctree(depth));
+}
+
+Octree* Mesh::makeOctree(int depth) {
+	Octree* tree = new Octree();
+	tree->create(getGeometry()->indices, getGeometry()->vertices, depth);
+	return tree;
+}
+
+void Mesh::setOctree(Octree* tree) {
 	if (collisionTree) {
 		delete collisionTree;
 	}
-	collisionTree = new Octree();
-	collisionTree->create(indices, vertices, depth);
+	collisionTree = tree;
 }
 
 bool Mesh::collides(Octree* other, glm::mat4 &otherTrans) {
@@ -162,3 +353,25 @@ bool Mesh::collides(Octree* other, glm::mat4 &otherTrans) {
 	}
 	return collisionTree->collides(other, getGlobalMatrix(), otherTrans, glm::inverse(getGlobalMatrix()));
 }
+
+size_t Mesh::getCpuMemory() {
+	size_t bytes = sizeof(Mesh);
+	bytes += indices.capacity() * sizeof(unsigned short);
+	bytes += vertices.capacity() * sizeof(glm::vec3);
+	if (collisionTree) {
+		bytes += collisionTree->getMemoryUsage();
+	}
+	return bytes;
+}
+
+size_t Mesh::getGpuMemory() {
+	if (arena) {
+		return MeshArena::getGpuMemory(allocation);
+	}
+	//Shared buffers are counted by the source mesh
+	if (geometrySource) {
+		return 0;
+	}
+	//Matches what setMesh uploads
+	return indices.size() * sizeof(unsigned short) + vertices.size() * sizeof(GpuVertex);
+}
@@ -8,6 +8,8 @@ A complex shape loaded from an obj file
 #include <vector>
 #include <string>
 #include "Octree.h"
+#include "MeshArena.h"
+#include "VertexFormat.h"
 
 using std::vector;
 using std::string;
@@ -19,10 +21,34 @@ public:
 	virtual ~Mesh();
 	// Sets the mesh
 	void setMesh(vector<unsigned short> indices, vector<glm::vec3> vertices, vector<glm::vec2> uvs, vector<glm::vec3> normals, vector<glm::vec3> tangents, vector<glm::vec3> bitangents);
+	// Sets the mesh, storing it in an arena rather than its own buffers
+	// It is then drawn along with the rest of the arena (with the arena's program), and can't have tangents
+	void setMesh(MeshArena* arena, vector<unsigned short> indices, vector<glm::vec3> vertices, vector<glm::vec2> uvs, vector<glm::vec3> normals);
+	// Gets where the mesh is stored in its arena
+	const MeshArena::Allocation& getAllocation() const { return allocation; };
+	// Uses the buffers of another mesh (and starts with its material) instead of uploading a copy
+	// The source must outlive this mesh
+	void shareMesh(Mesh* source);
+	// Gets the mesh whose buffers this mesh draws with
+	Mesh* getGeometry() { return geometrySource ? geometrySource : this; };
+	// Gets the number of indices drawn
+	GLsizei getIndexCount() { return static_cast<GLsizei>(getGeometry()->indices.size()); };
+	// Points attributes 0 to 3 and the element buffer of the bound vertex array at the mesh's buffers
+	void setupAttributes();
+	// Sets the uniforms that unpack the mesh's positions and UVs in program p
+	void bindQuantization(GLuint p);
+	// Binds the mesh's textures and sets its material uniforms in a multiLight program
+	void bindMaterial(const Shader& s);
+	// Sets up everything needed to draw the mesh, except the draw call itself
+	void bindDrawState(Camera* cam);
 	// Draws the mesh
-	void render(Camera* cam, GLuint depthMap, glm::mat4& LSM);
+	void render(Camera* cam);
+	// Sorts by program, textures, then vertex array
+	uint64_t getSortKey(unsigned int depth);
 	// Draws the mesh's shadow
 	void renderShadow(GLuint p);
+	// Draws the mesh into a software depth buffer
+	void rasterizeOccluder(OcclusionBuffer& buffer);
 	// Sets the shininess of the mesh
 	void setShininess(float shininess);
 	// Sets the texture of the mesh
@@ -33,6 +59,8 @@ public:
 	void setEmission(GLuint emission);
 	// Sets the normal map of the mesh
 	void setNormal(GLuint normal);
+	// Gets the id of the mesh's textures
+	unsigned int getMaterial() const { return material; };
 	// Sets the name of the mesh
 	void setName(string name);
 	// Gets the name of the mesh
@@ -41,30 +69,49 @@ public:
 	void setModel(Model* m);
 	// Creates an octree for the mesh
 	void createOctree(int depth);
+	// Builds an octree for the mesh without using it, so it can be done on another thread
+	Octree* makeOctree(int depth);
+	// Uses an octree from makeOctree, taking ownership of it
+	void setOctree(Octree* tree);
 	// Checks if the octree collides with anything
 	bool collides(Octree* other, glm::mat4 &otherTrans);
+	// Gets the bytes of CPU memory used by the mesh (including collision data)
+	size_t getCpuMemory();
+	// Gets the bytes of GPU memory used by the mesh's buffers
+	size_t getGpuMemory();
 	bool useNormalTexture;
 	Octree* collisionTree;
 private:
 	vector<unsigned short> indices;
 	vector<glm::vec3> vertices;
-	vector<glm::vec2> uvs;
-	vector<glm::vec3> normals;
-	vector<glm::vec3> tangents;
-	vector<glm::vec3> bitangents;
 	GLuint vertexArray;
 	GLuint elementBuffer;
+	//Interleaved GpuVertex data
 	GLuint vertexBuffer;
-	GLuint uvBuffer;
-	GLuint normalBuffer;
-	GLuint tangentBuffer;
-	GLuint bitangentBuffer;
+	bool hasTangents;
+	//Range the packed positions and UVs are fractions of
+	glm::vec3 positionOffset;
+	glm::vec3 positionScale;
+	glm::vec2 uvOffset;
+	glm::vec2 uvScale;
+	//Mesh the buffers above belong to, NULL if they are this mesh's own
+	Mesh* geometrySource;
+	//Arena the mesh is stored in, NULL if it has buffers of its own (or shares them)
+	MeshArena* arena;
+	MeshArena::Allocation allocation;
+	void createBuffers();
+	void deleteBuffers();
+	//Switches back to the multiLight program, after leaving an arena
+	void useMeshShader();
 	GLuint program;
 	GLuint diffuse;
 	GLuint specular;
 	float shininess;
 	GLuint emission;
 	GLuint normal;
+	//Id of the textures for sorting, updated when one is set
+	unsigned int material;
+	void updateMaterial();
 	string name;
 	Model* model;
 };
@@ -0,0 +1,329 @@
+#include "MeshArena.h"
+#include "Mesh.h"
+#include "GLState.h"
+#include "VertexFormat.h"
+#include "LightClusters.h"
+#include <algorithm>
+
+std::vector<MeshArena*> MeshArena::arenas;
+unsigned int MeshArena::flushDraws = 0;
+unsigned int MeshArena::flushMeshes = 0;
+
+bool MeshArena::RangeAllocator::allocate(GLuint size, GLuint& start) {
+	//First fit, the ranges are small and similar in size so this fragments little
+	for (std::map<GLuint, GLuint>::iterator it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+		if (it->second >= size) {
+			start = it->first;
+			GLuint remaining = it->second - size;
+			freeRanges.erase(it);
+			if (remaining > 0) {
+				freeRanges[start + size] = remaining;
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+void MeshArena::RangeAllocator::free(GLuint start, GLuint size) {
+	std::map<GLuint, GLuint>::iterator next = freeRanges.lower_bound(start);
+	//Merge with the range after
+	if (next != freeRanges.end() && start + size == next->first) {
+		size += next->second;
+		next = freeRanges.erase(next);
+	}
+	//Merge with the range before
+	if (next != freeRanges.begin()) {
+		std::map<GLuint, GLuint>::iterator prev = std::prev(next);
+		if (prev->first + prev->second == start) {
+			prev->second += size;
+			return;
+		}
+	}
+	freeRanges[start] = size;
+}
+
+MeshArena::MeshArena(float uvRange, GLsizei pageVertices, GLsizei pageIndices, GLsizei pageChunks) {
+	this->uvRange = uvRange;
+	this->pageVertices = pageVertices;
+	this->pageIndices = pageIndices;
+	this->pageChunks = glm::clamp(pageChunks, 1, static_cast<GLsizei>(MAX_PAGE_CHUNKS));
+	//Made up front, meshes take a copy of it before their first allocation
+	shader = Shader("shaders/multiLightArena.vert", "shaders/multiLight.frag");
+	GLState::useProgram(shader.getProgram());
+	glUniform1i(shader.getUniformLocation("shadow"), 0);
+	glUniform1i(shader.getUniformLocation("diffuse"), 1);
+	glUniform1i(shader.getUniformLocation("specular"), 2);
+	glUniform1i(shader.getUniformLocation("normalMap"), 3);
+	glUniform1i(shader.getUniformLocation("emissionMap"), 4);
+	glUniform1i(shader.getUniformLocation("chunks"), CHUNK_TEXTURE_UNIT);
+	LightClusters::setSamplers(shader);
+	arenas.push_back(this);
+}
+
+MeshArena::~MeshArena() {
+	for (Page& p : pages) {
+		releasePage(p);
+	}
+	arenas.erase(std::find(arenas.begin(), arenas.end(), this));
+}
+
+int MeshArena::addPage(GLsizei vertexCapacity, GLsizei indexCapacity) {
+	Page p;
+	p.vertexCapacity = vertexCapacity;
+	p.indexCapacity = indexCapacity;
+	p.chunkCapacity = pageChunks;
+	p.dirtyStart = 0;
+	p.dirtyEnd = 0;
+	glGenVertexArrays(1, &p.vertexArray);
+	glGenBuffers(1, &p.vertexBuffer);
+	glGenBuffers(1, &p.elementBuffer);
+	GLState::bindVertexArray(p.vertexArray);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, p.elementBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCapacity * sizeof(unsigned short), NULL, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, p.vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, vertexCapacity * sizeof(Vertex), NULL, GL_STATIC_DRAW);
+	//Same attribute locations as Mesh
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, uv));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 2, GL_SHORT, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+	//Location 3 is the tangent in Mesh's layout
+	glEnableVertexAttribArray(4);
+	glVertexAttribIPointer(4, 1, GL_UNSIGNED_SHORT, sizeof(Vertex), (void*)offsetof(Vertex, chunk));
+	//Chunk table, read by the vertex shader through a buffer texture
+	glGenBuffers(1, &p.chunkBuffer);
+	glGenTextures(1, &p.chunkTexture);
+	p.chunkData.assign(p.chunkCapacity * 2, glm::vec4(0.0f));
+	glBindBuffer(GL_TEXTURE_BUFFER, p.chunkBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, p.chunkData.size() * sizeof(glm::vec4), &p.chunkData[0], GL_DYNAMIC_DRAW);
+	GLState::bindTexture(CHUNK_TEXTURE_UNIT, GL_TEXTURE_BUFFER, p.chunkTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, p.chunkBuffer);
+	p.vertices.freeRanges[0] = vertexCapacity;
+	p.indices.freeRanges[0] = indexCapacity;
+	p.chunks.freeRanges[0] = p.chunkCapacity;
+	for (size_t i = 0; i < pages.size(); i++) {
+		if (pages[i].vertexCapacity == 0) {
+			pages[i] = p;
+			return static_cast<int>(i);
+		}
+	}
+	pages.push_back(p);
+	return static_cast<int>(pages.size()) - 1;
+}
+
+void MeshArena::releasePage(Page& p) {
+	if (p.vertexCapacity == 0) {
+		return;
+	}
+	GLState::deleteVertexArray(p.vertexArray);
+	glDeleteBuffers(1, &p.vertexBuffer);
+	glDeleteBuffers(1, &p.elementBuffer);
+	glDeleteBuffers(1, &p.chunkBuffer);
+	GLState::deleteTexture(p.chunkTexture);
+	p.vertexBuffer = 0;
+	p.elementBuffer = 0;
+	p.chunkBuffer = 0;
+	p.vertexCapacity = 0;
+	p.indexCapacity = 0;
+	p.chunkCapacity = 0;
+	//Nothing fits in a released page, so allocate skips it
+	p.vertices.freeRanges.clear();
+	p.indices.freeRanges.clear();
+	p.chunks.freeRanges.clear();
+	std::vector<glm::vec4>().swap(p.chunkData);
+	p.dirtyStart = 0;
+	p.dirtyEnd = 0;
+}
+
+MeshArena::Allocation MeshArena::allocate(const std::vector<unsigned short>& indices, const std::vector<glm::vec3>& vertices,
+	const std::vector<glm::vec2>& uvs, const std::vector<glm::vec3>& normals) {
+	Allocation a;
+	GLsizei numVerts = static_cast<GLsizei>(vertices.size());
+	GLsizei numIndices = static_cast<GLsizei>(indices.size());
+	if (numVerts == 0 || numIndices == 0) {
+		return a;
+	}
+	GLuint vertexStart = 0;
+	GLuint indexStart = 0;
+	GLuint chunk = 0;
+	//Lower pages are filled first, so meshes gather in them and the last pages empty out to be released
+	for (size_t p = 0; p < pages.size() && a.page < 0; p++) {
+		if (reserve(pages[p], numVerts, numIndices, vertexStart, indexStart, chunk)) {
+			a.page = static_cast<int>(p);
+		}
+	}
+	if (a.page < 0) {
+		//Every page is full, a mesh bigger than a page gets a page to itself
+		a.page = addPage(glm::max(pageVertices, numVerts), glm::max(pageIndices, numIndices));
+		reserve(pages[a.page], numVerts, numIndices, vertexStart, indexStart, chunk);
+	}
+	a.firstIndex = indexStart;
+	a.indexCount = numIndices;
+	a.baseVertex = static_cast<GLint>(vertexStart);
+	a.vertexCount = numVerts;
+	a.chunk = chunk;
+	//Positions are stored as fractions of the mesh's bounds
+	glm::vec3 min = vertices[0];
+	glm::vec3 max = vertices[0];
+	for (const glm::vec3& v : vertices) {
+		min = glm::min(min, v);
+		max = glm::max(max, v);
+	}
+	a.positionOffset = min;
+	a.positionScale = glm::vec3(VertexFormat::rangeScale(min.x, max.x), VertexFormat::rangeScale(min.y, max.y), VertexFormat::rangeScale(min.z, max.z));
+	interleaved.resize(numVerts);
+	for (GLsizei i = 0; i < numVerts; i++) {
+		for (int c = 0; c < 3; c++) {
+			interleaved[i].position[c] = VertexFormat::quantize(vertices[i][c], a.positionOffset[c], a.positionScale[c]);
+		}
+		interleaved[i].chunk = static_cast<GLushort>(chunk);
+		glm::vec2 uv = i < static_cast<GLsizei>(uvs.size()) ? uvs[i] : glm::vec2(0.0f);
+		interleaved[i].uv[0] = VertexFormat::quantize(uv.x, 0.0f, uvRange);
+		interleaved[i].uv[1] = VertexFormat::quantize(uv.y, 0.0f, uvRange);
+		glm::vec3 n = i < static_cast<GLsizei>(normals.size()) ? normals[i] : glm::vec3(0.0f, 1.0f, 0.0f);
+		VertexFormat::encodeNormal(glm::normalize(n), interleaved[i].normal);
+	}
+	Page& page = pages[a.page];
+	glBindBuffer(GL_ARRAY_BUFFER, page.vertexBuffer);
+	glBufferSubData(GL_ARRAY_BUFFER, vertexStart * sizeof(Vertex), numVerts * sizeof(Vertex), &interleaved[0]);
+	//Not bound through the VAO, so uploading doesn't depend on which VAO is bound
+	glBindBuffer(GL_COPY_WRITE_BUFFER, page.elementBuffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, indexStart * sizeof(unsigned short), numIndices * sizeof(unsigned short), &indices[0]);
+	//The size of the chunk never changes, where it starts is set when it is drawn
+	page.chunkData[chunk * 2 + 1] = glm::vec4(a.positionScale, 0.0f);
+	setChunkStart(page, chunk, a.positionOffset);
+	return a;
+}
+
+bool MeshArena::reserve(Page& p, GLsizei numVerts, GLsizei numIndices, GLuint& vertexStart, GLuint& indexStart, GLuint& chunk) {
+	if (!p.vertices.allocate(numVerts, vertexStart)) {
+		return false;
+	}
+	if (!p.indices.allocate(numIndices, indexStart)) {
+		p.vertices.free(vertexStart, numVerts);
+		return false;
+	}
+	if (!p.chunks.allocate(1, chunk)) {
+		p.vertices.free(vertexStart, numVerts);
+		p.indices.free(indexStart, numIndices);
+		return false;
+	}
+	return true;
+}
+
+void MeshArena::setChunkStart(Page& p, GLuint chunk, const glm::vec3& start) {
+	glm::vec4 texel = glm::vec4(start, 0.0f);
+	if (p.chunkData[chunk * 2] == texel) {
+		return;
+	}
+	p.chunkData[chunk * 2] = texel;
+	//Both texels of the chunk are uploaded, so a new chunk's size goes with it
+	if (p.dirtyStart == p.dirtyEnd) {
+		p.dirtyStart = chunk;
+		p.dirtyEnd = chunk + 1;
+	} else {
+		p.dirtyStart = glm::min(p.dirtyStart, chunk);
+		p.dirtyEnd = glm::max(p.dirtyEnd, chunk + 1);
+	}
+}
+
+void MeshArena::free(Allocation& a) {
+	if (a.page < 0) {
+		return;
+	}
+	Page& page = pages[a.page];
+	page.vertices.free(a.baseVertex, a.vertexCount);
+	page.indices.free(a.firstIndex, a.indexCount);
+	page.chunks.free(a.chunk, 1);
+	//A mesh might be queued and freed in the same frame
+	queued.erase(std::remove_if(queued.begin(), queued.end(), [&a](Mesh* m) { return &m->getAllocation() == &a; }), queued.end());
+	//Give the memory back once nothing is left in the page
+	if (page.chunks.freeRanges.size() == 1 && page.chunks.freeRanges.begin()->second == static_cast<GLuint>(page.chunkCapacity)) {
+		releasePage(page);
+	}
+	a = Allocation();
+}
+
+size_t MeshArena::getGpuMemory(const Allocation& a) {
+	return a.vertexCount * sizeof(Vertex) + a.indexCount * sizeof(unsigned short);
+}
+
+size_t MeshArena::getReservedMemory() const {
+	size_t bytes = 0;
+	for (const Page& p : pages) {
+		bytes += p.vertexCapacity * sizeof(Vertex) + p.indexCapacity * sizeof(unsigned short);
+		bytes += p.chunkData.size() * sizeof(glm::vec4);
+	}
+	return bytes;
+}
+
+void MeshArena::queue(Mesh* m) {
+	queued.push_back(m);
+}
+
+void MeshArena::flushAll(Camera* cam) {
+	flushDraws = 0;
+	flushMeshes = 0;
+	for (MeshArena* a : arenas) {
+		a->flush(cam);
+	}
+}
+
+void MeshArena::flush(Camera* cam) {
+	if (queued.empty()) {
+		return;
+	}
+	//Find where each chunk starts from its global transform, which is precise near the camera
+	for (Mesh* m : queued) {
+		const Allocation& a = m->getAllocation();
+		glm::mat4 global = m->getGlobalMatrix();
+		setChunkStart(pages[a.page], a.chunk, glm::vec3(global[3]) + glm::mat3(global) * a.positionOffset);
+	}
+	for (Page& p : pages) {
+		if (p.dirtyStart != p.dirtyEnd) {
+			glBindBuffer(GL_TEXTURE_BUFFER, p.chunkBuffer);
+			glBufferSubData(GL_TEXTURE_BUFFER, p.dirtyStart * 2 * sizeof(glm::vec4), (p.dirtyEnd - p.dirtyStart) * 2 * sizeof(glm::vec4), &p.chunkData[p.dirtyStart * 2]);
+			p.dirtyStart = 0;
+			p.dirtyEnd = 0;
+		}
+	}
+	//Meshes sharing a page, parent (so rotation and scale) and material can be drawn together
+	std::sort(queued.begin(), queued.end(), [](Mesh* a, Mesh* b) {
+		if (a->getAllocation().page != b->getAllocation().page) {
+			return a->getAllocation().page < b->getAllocation().page;
+		}
+		if (a->getParent() != b->getParent()) {
+			return a->getParent() < b->getParent();
+		}
+		return a->getMaterial() < b->getMaterial();
+	});
+	size_t start = 0;
+	while (start < queued.size()) {
+		Mesh* first = queued[start];
+		size_t end = start + 1;
+		while (end < queued.size() && queued[end]->getAllocation().page == first->getAllocation().page &&
+			queued[end]->getParent() == first->getParent() && queued[end]->getMaterial() == first->getMaterial()) {
+			end++;
+		}
+		counts.clear();
+		offsets.clear();
+		baseVertices.clear();
+		for (size_t i = start; i < end; i++) {
+			const Allocation& a = queued[i]->getAllocation();
+			counts.push_back(a.indexCount);
+			offsets.push_back(reinterpret_cast<const void*>(a.firstIndex * sizeof(unsigned short)));
+			baseVertices.push_back(a.baseVertex);
+		}
+		//Every mesh in the run has the same state as the first
+		first->bindDrawState(cam);
+		GLState::bindTexture(CHUNK_TEXTURE_UNIT, GL_TEXTURE_BUFFER, pages[first->getAllocation().page].chunkTexture);
+		glMultiDrawElementsBaseVertex(GL_TRIANGLES, &counts[0], GL_UNSIGNED_SHORT, &offsets[0], static_cast<GLsizei>(counts.size()), &baseVertices[0]);
+		flushDraws++;
+		flushMeshes += static_cast<unsigned int>(end - start);
+		start = end;
+	}
+	queued.clear();
+}
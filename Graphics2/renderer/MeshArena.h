@@ -0,0 +1,133 @@
+#pragma once
+/*
+Large shared buffers that many small meshes (eg terrain chunks) are suballocated from.
+Meshes in an arena don't draw themselves, they queue up and are drawn together with one
+glMultiDrawElementsBaseVertex per page, parent and material once the opaque pass is done.
+Each mesh is a chunk with its own 16 bit positions, stored as fractions of its bounds.
+Where each chunk's bounds start is kept in a buffer texture per page, refreshed from the
+chunk's (double precision) global position whenever it is drawn, so chunks far from the
+origin stay precise near the camera. A chunk can be moved, but every chunk drawn under one
+parent must share the same rotation and scale.
+Vertices are interleaved position, chunk, UV and normal (no tangents), UVs are 16 bit
+fractions of the arena's UV range.
+*/
+#include "OpenGLSetup.h"
+#include "Shader.h"
+#include "glm/glm.hpp"
+#include <vector>
+#include <map>
+#include <cstdint>
+
+class Mesh;
+class Camera;
+
+class MeshArena {
+public:
+	//Where a mesh lives in the arena
+	struct Allocation {
+		int page;
+		GLuint firstIndex;
+		GLsizei indexCount;
+		GLint baseVertex;
+		GLsizei vertexCount;
+		//Entry in the page's chunk table
+		GLuint chunk;
+		//Range the mesh's positions are fractions of
+		glm::vec3 positionOffset;
+		glm::vec3 positionScale;
+		Allocation() : page(-1), firstIndex(0), indexCount(0), baseVertex(0), vertexCount(0), chunk(0),
+			positionOffset(0.0f), positionScale(1.0f) {};
+	};
+	// UVs must be between 0 and uvRange
+	// Pages hold at least this many vertices, indices and chunks, more are added as they fill up
+	// and released once everything in them is freed
+	MeshArena(float uvRange = 1.0f, GLsizei pageVertices = 1 << 18, GLsizei pageIndices = 1 << 20, GLsizei pageChunks = 1 << 12);
+	~MeshArena();
+	// Copies a mesh into the arena, indices are relative to the mesh's first vertex
+	Allocation allocate(const std::vector<unsigned short>& indices, const std::vector<glm::vec3>& vertices,
+		const std::vector<glm::vec2>& uvs, const std::vector<glm::vec3>& normals);
+	// Frees the space used by a mesh
+	void free(Allocation& a);
+	// Gets the range UVs are stored as fractions of
+	float getUVRange() const { return uvRange; };
+	// Gets the program meshes in the arena are drawn with
+	const Shader& getShader() const { return shader; };
+	// Gets the vertex array a page is drawn with
+	GLuint getVertexArray(int page) const { return pages[page].vertexArray; };
+	// Gets the bytes of GPU memory used by an allocation
+	static size_t getGpuMemory(const Allocation& a);
+	// Gets the bytes of GPU memory reserved by every page, which is what the arena actually holds
+	size_t getReservedMemory() const;
+	// Queues a mesh to be drawn when the arena is flushed
+	void queue(Mesh* m);
+	// Draws every mesh queued in any arena
+	static void flushAll(Camera* cam);
+	// Gets the number of draw calls made by the last flushAll, and the meshes they drew
+	static unsigned int getFlushDrawCount() { return flushDraws; };
+	static unsigned int getFlushMeshCount() { return flushMeshes; };
+private:
+	//Interleaved vertex layout (16 bytes)
+	struct Vertex {
+		//Fraction of the chunk's bounds
+		GLushort position[3];
+		GLushort chunk;
+		GLushort uv[2];
+		GLshort normal[2];
+	};
+	//Texture unit the chunk table is bound to
+	enum { CHUNK_TEXTURE_UNIT = 5 };
+	//Largest number of chunks a page can have, chunk indices are 16 bit
+	enum { MAX_PAGE_CHUNKS = 1 << 16 };
+	//Free ranges of a buffer, start -> size, adjacent ranges are merged
+	struct RangeAllocator {
+		std::map<GLuint, GLuint> freeRanges;
+		//Returns false if no range is big enough
+		bool allocate(GLuint size, GLuint& start);
+		void free(GLuint start, GLuint size);
+	};
+	//Released pages keep their slot (allocations refer to pages by index) with no capacity
+	struct Page {
+		GLuint vertexArray;
+		GLuint vertexBuffer;
+		GLuint elementBuffer;
+		//Two texels per chunk, where its bounds start in world space and their size
+		GLuint chunkBuffer;
+		GLuint chunkTexture;
+		GLsizei vertexCapacity;
+		GLsizei indexCapacity;
+		GLsizei chunkCapacity;
+		RangeAllocator vertices;
+		RangeAllocator indices;
+		RangeAllocator chunks;
+		//Copy of the chunk table, and the part changed since it was last uploaded
+		std::vector<glm::vec4> chunkData;
+		GLuint dirtyStart;
+		GLuint dirtyEnd;
+	};
+	MeshArena(const MeshArena& other) = delete;
+	MeshArena& operator=(const MeshArena& other) = delete;
+	//Creates a page, reusing a released slot if there is one, and returns its index
+	int addPage(GLsizei vertexCapacity, GLsizei indexCapacity);
+	//Deletes a page's buffers, leaving an empty slot
+	void releasePage(Page& p);
+	//Takes space for a mesh from a page, returning false (and taking nothing) if it doesn't fit
+	bool reserve(Page& p, GLsizei numVerts, GLsizei numIndices, GLuint& vertexStart, GLuint& indexStart, GLuint& chunk);
+	//Sets where a chunk starts, to be uploaded before the page is next drawn
+	void setChunkStart(Page& p, GLuint chunk, const glm::vec3& start);
+	void flush(Camera* cam);
+	float uvRange;
+	GLsizei pageVertices;
+	GLsizei pageIndices;
+	GLsizei pageChunks;
+	Shader shader;
+	std::vector<Page> pages;
+	std::vector<Mesh*> queued;
+	//Scratch space for building multi draws
+	std::vector<GLsizei> counts;
+	std::vector<const void*> offsets;
+	std::vector<GLint> baseVertices;
+	std::vector<Vertex> interleaved;
+	static std::vector<MeshArena*> arenas;
+	static unsigned int flushDraws;
+	static unsigned int flushMeshes;
+};
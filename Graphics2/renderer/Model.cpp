@@ -4,12 +4,15 @@
 #include <stb_image.h>
 #include <iostream>
 
+std::map<std::string, Model*> Model::prototypes;
 
 Model::Model() {
 }
 
 
 Model::~Model() {
+	meshes.clear();
+	meshPool.clear();
 }
 
 void Model::indexVBO(
@@ -48,6 +51,42 @@ void Model::indexVBO(
 }
 
 bool Model::loadModel(const char* path) {
+	Model* prototype = getPrototype(path);
+	if (!prototype) {
+		return false;
+	}
+	for (Mesh* p : prototype->meshes) {
+		Mesh* m = meshPool.get(meshPool.create());
+		m->shareMesh(p);
+		m->setParent(this);
+		m->setModel(this);
+		meshes.push_back(m);
+	}
+	return true;
+}
+
+Model* Model::getPrototype(const std::string& path) {
+	std::map<std::string, Model*>::iterator it = prototypes.find(path);
+	if (it != prototypes.end()) {
+		return it->second;
+	}
+	Model* prototype = new Model();
+	if (!prototype->loadObj(path.c_str())) {
+		delete prototype;
+		return NULL;
+	}
+	prototypes[path] = prototype;
+	return prototype;
+}
+
+void Model::clearPrototypes() {
+	for (std::pair<const std::string, Model*>& p : prototypes) {
+		delete p.second;
+	}
+	prototypes.clear();
+}
+
+bool Model::loadObj(const char* path) {
 	tinyobj::attrib_t attrib;
 	std::vector<tinyobj::shape_t> shapes;
 	std::vector<tinyobj::material_t> materials;
@@ -69,7 +108,7 @@ bool Model::loadModel(const char* path) {
 		return false;
 	}
 	for (tinyobj::shape_t s : shapes) {
-		Mesh* m = new Mesh();
+		Mesh* m = meshPool.get(meshPool.create());
 		m->setName(s.name);
 		//Construct list for each mesh
 		std::vector<glm::vec3> verts;
@@ -140,6 +179,14 @@ void Model::renderShadow(GLuint p) {
 	}
 }
 
+AABB Model::getBounds() {
+	AABB bounds;
+	for (Mesh* m : meshes) {
+		bounds.expand(m->getLocalBounds().transform(m->getLocalMatrix()));
+	}
+	return bounds;
+}
+
 void Model::indexVBO(
 	std::vector<glm::vec3> & in_vertices,
 	std::vector<glm::vec2> & in_uvs,
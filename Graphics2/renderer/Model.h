@@ -1,12 +1,17 @@
 #pragma once
 /*
 A model contains meshes that make up one model
+Each obj file is only loaded once, into a prototype that is never drawn. Models
+loaded from the same file share the prototype's buffers.
 */
 #include "OpenGLSetup.h"
 #include <vector>
 #include "SceneObject.h"
 #include "Octree.h"
+#include "Bounds.h"
+#include "Pool.h"
 #include <tiny_obj_loader.h>
+#include <string>
 
 
 using std::vector;
@@ -20,12 +25,18 @@ public:
 	~Model();
 	// Loads the model from an obj file, returns true on success
 	bool loadModel(const char* path);
+	// Gets the prototype of an obj file, loading it the first time, or NULL if it fails to load
+	static Model* getPrototype(const std::string& path);
+	// Deletes every prototype, any model still sharing their buffers must be deleted first
+	static void clearPrototypes();
 	// Creates octrees for the children of the model
 	void createOctrees(int maxDepth);
 	// Checks if the octree collides with anything
 	bool collides(Octree* other, glm::mat4 &otherTrans);
 	// Renders shadows of a model
 	void renderShadow(GLuint p);
+	// Gets the box containing all of the model's meshes, in the model's space
+	AABB getBounds();
 	std::vector<Mesh*> meshes;
 	//"Borrowed" from opengl-tutorials
 	static void indexVBO(
@@ -61,6 +72,11 @@ public:
 		std::vector<glm::vec3> & bitangents
 	);
 private:
+	//Loads the meshes from an obj file, giving them their own buffers
+	bool loadObj(const char* path);
+	//Owns the meshes, freeing them with the model
+	Pool<Mesh> meshPool;
+	static std::map<std::string, Model*> prototypes;
 	struct PackedVertex {
 		glm::vec3 position;
 		glm::vec2 uv;
@@ -0,0 +1,150 @@
+#include "OcclusionBuffer.h"
+#include <emmintrin.h>
+#include <algorithm>
+#include <cfloat>
+
+//Points closer than this (in clip w) aren't projected
+#define NEAR_W 1e-4f
+
+OcclusionBuffer::OcclusionBuffer(int width, int height) {
+	this->width = glm::max((width + 3) & ~3, 4);
+	this->height = glm::max(height, 1);
+	depth.resize(this->width * this->height, 1.0f);
+	viewProj = glm::mat4(1);
+	triangles = 0;
+}
+
+void OcclusionBuffer::clear(const glm::mat4& viewProj) {
+	this->viewProj = viewProj;
+	std::fill(depth.begin(), depth.end(), 1.0f);
+	triangles = 0;
+}
+
+bool OcclusionBuffer::project(const glm::vec4& clip, glm::vec3& screen) const {
+	if (clip.w < NEAR_W) {
+		return false;
+	}
+	glm::vec3 ndc = glm::vec3(clip) / clip.w;
+	screen = glm::vec3((ndc.x * 0.5f + 0.5f) * width, (ndc.y * 0.5f + 0.5f) * height, ndc.z * 0.5f + 0.5f);
+	return true;
+}
+
+void OcclusionBuffer::rasterize(const std::vector<glm::vec3>& vertices, const std::vector<unsigned short>& indices, const glm::mat4& model) {
+	glm::mat4 mvp = viewProj * model;
+	screenVerts.resize(vertices.size());
+	screenValid.resize(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++) {
+		screenValid[i] = project(mvp * glm::vec4(vertices[i], 1.0f), screenVerts[i]);
+	}
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		unsigned short a = indices[i];
+		unsigned short b = indices[i + 1];
+		unsigned short c = indices[i + 2];
+		//Triangles crossing the near plane are skipped, which only makes culling less aggressive
+		if (!screenValid[a] || !screenValid[b] || !screenValid[c]) {
+			continue;
+		}
+		drawTriangle(screenVerts[a], screenVerts[b], screenVerts[c]);
+	}
+}
+
+void OcclusionBuffer::drawTriangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+	//Edge functions, flipped so the inside is positive whatever the winding
+	float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+	if (area == 0.0f) {
+		return;
+	}
+	float sign = area > 0.0f ? 1.0f : -1.0f;
+	glm::vec3 v[3] = { a, b, c };
+	float ea[3], eb[3], ec[3];
+	for (int i = 0; i < 3; i++) {
+		const glm::vec3& p = v[i];
+		const glm::vec3& q = v[(i + 1) % 3];
+		ea[i] = sign * (p.y - q.y);
+		eb[i] = sign * (q.x - p.x);
+		ec[i] = sign * (p.x * q.y - p.y * q.x);
+	}
+	int minX = glm::max(static_cast<int>(floor(glm::min(glm::min(a.x, b.x), c.x))), 0);
+	int maxX = glm::min(static_cast<int>(ceil(glm::max(glm::max(a.x, b.x), c.x))), width - 1);
+	int minY = glm::max(static_cast<int>(floor(glm::min(glm::min(a.y, b.y), c.y))), 0);
+	int maxY = glm::min(static_cast<int>(ceil(glm::max(glm::max(a.y, b.y), c.y))), height - 1);
+	if (minX > maxX || minY > maxY) {
+		return;
+	}
+	triangles++;
+	//Write the furthest depth of the triangle, so it never hides more than it should
+	__m128 z = _mm_set1_ps(glm::max(glm::max(a.z, b.z), c.z));
+	__m128 zero = _mm_setzero_ps();
+	__m128 offsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+	minX &= ~3;
+	for (int y = minY; y <= maxY; y++) {
+		float py = y + 0.5f;
+		float* row = &depth[y * width];
+		for (int x = minX; x <= maxX; x += 4) {
+			//Sample 4 pixel centres at once
+			__m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), offsets);
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (int e = 0; e < 3; e++) {
+				__m128 edge = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(ea[e])), _mm_set1_ps(eb[e] * py + ec[e]));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(edge, zero));
+			}
+			__m128 old = _mm_loadu_ps(row + x);
+			__m128 updated = _mm_min_ps(old, z);
+			_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, updated), _mm_andnot_ps(inside, old)));
+		}
+	}
+}
+
+bool OcclusionBuffer::isVisible(const AABB& box) const {
+	if (box.isEmpty()) {
+		return true;
+	}
+	//Screen rectangle and nearest depth of the box
+	float minX = FLT_MAX;
+	float minY = FLT_MAX;
+	float maxX = -FLT_MAX;
+	float maxY = -FLT_MAX;
+	float minZ = FLT_MAX;
+	for (int i = 0; i < 8; i++) {
+		glm::vec3 corner = glm::vec3(i & 1 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y, i & 4 ? box.max.z : box.min.z);
+		glm::vec3 s;
+		if (!project(viewProj * glm::vec4(corner, 1.0f), s)) {
+			//Reaches the viewer, so can't be hidden
+			return true;
+		}
+		minX = glm::min(minX, s.x);
+		minY = glm::min(minY, s.y);
+		maxX = glm::max(maxX, s.x);
+		maxY = glm::max(maxY, s.y);
+		minZ = glm::min(minZ, s.z);
+	}
+	int x0 = glm::max(static_cast<int>(floor(minX)), 0);
+	int x1 = glm::min(static_cast<int>(ceil(maxX)), width - 1);
+	int y0 = glm::max(static_cast<int>(floor(minY)), 0);
+	int y1 = glm::min(static_cast<int>(ceil(maxY)), height - 1);
+	if (x0 > x1 || y0 > y1) {
+		//Off screen, leave it to frustum culling
+		return true;
+	}
+	__m128 z = _mm_set1_ps(minZ);
+	int start = x0 & ~3;
+	for (int y = y0; y <= y1; y++) {
+		const float* row = &depth[y * width];
+		for (int x = start; x <= x1; x += 4) {
+			//Only look at the pixels within the rectangle
+			int mask = 0xF;
+			if (x < x0) {
+				mask &= 0xF << (x0 - x);
+			}
+			if (x + 3 > x1) {
+				mask &= 0xF >> (x + 3 - x1);
+			}
+			//Visible if anything drawn there is further away than the box
+			int further = _mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), z));
+			if (further & mask) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
@@ -0,0 +1,40 @@
+#pragma once
+/*
+A small software depth buffer used for occlusion culling.
+A few large occluders are rasterized into it on the CPU (using SSE), then the
+bounding boxes of everything else are tested against it before being drawn.
+Doesn't use OpenGL at all.
+*/
+#include <vector>
+#include "glm/glm.hpp"
+#include "Bounds.h"
+
+class OcclusionBuffer {
+public:
+	// Width is rounded up to a multiple of 4
+	OcclusionBuffer(int width = 128, int height = 64);
+	// Resets the buffer to the far plane and sets the matrix used to project everything
+	void clear(const glm::mat4& viewProj);
+	// Draws an indexed triangle list (in model space) into the buffer
+	void rasterize(const std::vector<glm::vec3>& vertices, const std::vector<unsigned short>& indices, const glm::mat4& model);
+	// Checks if any part of a box (in world space) could be in front of the occluders
+	bool isVisible(const AABB& box) const;
+	// Gets the number of triangles drawn since the last clear
+	unsigned int getTriangleCount() const { return triangles; };
+	int getWidth() const { return width; };
+	int getHeight() const { return height; };
+	// Gets the depth at a pixel (0 is near, 1 is far)
+	float getDepth(int x, int y) const { return depth[x + y * width]; };
+private:
+	//Projects a point, returns false if it is too close to (or behind) the viewer
+	bool project(const glm::vec4& clip, glm::vec3& screen) const;
+	void drawTriangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c);
+	int width;
+	int height;
+	glm::mat4 viewProj;
+	std::vector<float> depth;
+	//Vertices of the mesh being drawn, after projection
+	std::vector<glm::vec3> screenVerts;
+	std::vector<char> screenValid;
+	unsigned int triangles;
+};
@@ -188,6 +188,18 @@ bool Octree::collides(Octree* other, glm::mat4 &trans, glm::mat4 &otherTrans, gl
 	return false;
 }
 
+size_t Octree::getMemoryUsage() {
+	size_t bytes = sizeof(Octree);
+	bytes += coords.capacity() * sizeof(glm::vec3);
+	bytes += children.capacity() * sizeof(Octree*);
+	//Each list node holds a vector of 3 points
+	bytes += tris.size() * (sizeof(std::vector<glm::vec3>) + 2 * sizeof(void*) + 3 * sizeof(glm::vec3));
+	for (Octree* child : children) {
+		bytes += child->getMemoryUsage();
+	}
+	return bytes;
+}
+
 //void Octree::draw(glm::mat4 &trans, Camera* cam) {
 //	glUseProgram(shader.getProgram());
 //	glBindVertexArray(vertexArray);
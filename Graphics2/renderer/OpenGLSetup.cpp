@@ -1,4 +1,5 @@
 #include "OpenGLSetup.h"
+#include "GLState.h"
 #include <iostream>
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
@@ -75,8 +76,7 @@ void OpenGLSetup::sharedInit() {
 		glfwTerminate();
 		exit(1);
 	}
-	glEnable(GL_CULL_FACE);
-	glCullFace(GL_BACK);
+	GLState::setCulling(true, GL_BACK);
 	//Useful debug info about the graphics card in use
 	//(This is where I learnt I was using an integrated chip by default)
 	std::cout << "OpenGL version: " << glGetString(GL_VERSION) << std::endl
@@ -97,7 +97,7 @@ GLuint OpenGLSetup::loadImage(std::string filename) {
 	unsigned char* data = nullptr;
 	data = stbi_load(filename.c_str(), &width, &height, &channels, 0);
 	if (data) {
-		glBindTexture(GL_TEXTURE_2D, tex);
+		GLState::bindTexture(0, GL_TEXTURE_2D, tex);
 		glTexImage2D(GL_TEXTURE_2D, 0, channels == 3 ? GL_RGB : GL_RGBA, width, height, 0, channels == 3 ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, data);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
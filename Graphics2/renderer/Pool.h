@@ -0,0 +1,163 @@
+#pragma once
+/*
+A pool of objects of one type, allocated in fixed size blocks so objects sit next to
+each other in memory and never move once created.
+Objects can be referred to by handles, which hold a slot and the generation of the
+object in it, so a handle to a destroyed object is detected instead of dangling.
+Destroying the pool destroys every object still in it.
+*/
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <type_traits>
+
+template<typename T>
+class Pool {
+public:
+	struct Handle {
+		uint32_t index;
+		uint32_t generation;
+		Handle() : index(0xFFFFFFFF), generation(0) {};
+		bool operator==(const Handle& other) const { return index == other.index && generation == other.generation; };
+		bool operator!=(const Handle& other) const { return !(*this == other); };
+	};
+	Pool(size_t blockSize = 64);
+	~Pool();
+	// Creates an object, passing args to its constructor
+	template<typename... Args>
+	Handle create(Args&&... args);
+	// Gets the object a handle refers to, or NULL if it has been destroyed
+	T* get(Handle h) const;
+	// Gets the handle of an object created by this pool
+	Handle getHandle(const T* obj) const;
+	// Destroys an object, returning false if it was already destroyed
+	bool destroy(Handle h);
+	bool destroy(T* obj);
+	// Destroys every object in the pool, the memory is kept for reuse
+	void clear();
+	// Gets the number of objects in the pool
+	size_t size() const { return live; };
+	// Gets the number of bytes reserved by the pool
+	size_t getMemory() const { return blocks.size() * blockSize * sizeof(Slot); };
+private:
+	struct Slot {
+		//Must come first, so a pointer to the object is also a pointer to its slot
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+		uint32_t index;
+		uint32_t generation;
+		uint32_t nextFree;
+		bool alive;
+	};
+	enum { NO_SLOT = 0xFFFFFFFF };
+	Pool(const Pool& other) = delete;
+	Pool& operator=(const Pool& other) = delete;
+	Slot* getSlot(uint32_t index) const { return &blocks[index / blockSize][index % blockSize]; };
+	std::vector<Slot*> blocks;
+	size_t blockSize;
+	uint32_t firstFree;
+	size_t live;
+};
+
+template<typename T>
+Pool<T>::Pool(size_t blockSize) {
+	this->blockSize = blockSize > 0 ? blockSize : 1;
+	firstFree = NO_SLOT;
+	live = 0;
+}
+
+template<typename T>
+Pool<T>::~Pool() {
+	clear();
+	for (Slot* b : blocks) {
+		delete[] b;
+	}
+}
+
+template<typename T>
+template<typename... Args>
+typename Pool<T>::Handle Pool<T>::create(Args&&... args) {
+	if (firstFree == NO_SLOT) {
+		//Add a block, chaining its slots onto the free list
+		Slot* block = new Slot[blockSize];
+		uint32_t start = static_cast<uint32_t>(blocks.size() * blockSize);
+		for (size_t i = 0; i < blockSize; i++) {
+			block[i].index = start + static_cast<uint32_t>(i);
+			block[i].generation = 0;
+			block[i].alive = false;
+			block[i].nextFree = i + 1 < blockSize ? start + static_cast<uint32_t>(i + 1) : NO_SLOT;
+		}
+		blocks.push_back(block);
+		firstFree = start;
+	}
+	Slot* s = getSlot(firstFree);
+	firstFree = s->nextFree;
+	new (&s->storage) T(std::forward<Args>(args)...);
+	s->alive = true;
+	live++;
+	Handle h;
+	h.index = s->index;
+	h.generation = s->generation;
+	return h;
+}
+
+template<typename T>
+T* Pool<T>::get(Handle h) const {
+	if (h.index >= blocks.size() * blockSize) {
+		return NULL;
+	}
+	Slot* s = getSlot(h.index);
+	if (!s->alive || s->generation != h.generation) {
+		return NULL;
+	}
+	return reinterpret_cast<T*>(&s->storage);
+}
+
+template<typename T>
+typename Pool<T>::Handle Pool<T>::getHandle(const T* obj) const {
+	const Slot* s = reinterpret_cast<const Slot*>(obj);
+	Handle h;
+	h.index = s->index;
+	h.generation = s->generation;
+	return h;
+}
+
+template<typename T>
+bool Pool<T>::destroy(Handle h) {
+	T* obj = get(h);
+	if (!obj) {
+		return false;
+	}
+	Slot* s = getSlot(h.index);
+	obj->~T();
+	s->alive = false;
+	//Any handles still pointing here are now stale
+	s->generation++;
+	s->nextFree = firstFree;
+	firstFree = s->index;
+	live--;
+	return true;
+}
+
+template<typename T>
+bool Pool<T>::destroy(T* obj) {
+	if (!obj) {
+		return false;
+	}
+	return destroy(getHandle(obj));
+}
+
+template<typename T>
+void Pool<T>::clear() {
+	for (size_t b = 0; b < blocks.size() && live > 0; b++) {
+		for (size_t i = 0; i < blockSize; i++) {
+			if (blocks[b][i].alive) {
+				Handle h;
+				h.index = blocks[b][i].index;
+				h.generation = blocks[b][i].generation;
+				destroy(h);
+			}
+		}
+	}
+}
@@ -1,4 +1,5 @@
 #include "Portal.h"
+#include "GLState.h"
 #include "glm/gtc/matrix_transform.hpp"
 
 
@@ -15,16 +16,16 @@ void Portal::initPortalMap() {
 	glfwGetWindowSize(OpenGLSetup::window, &width, &height);
 	//Generate buffers
 	glGenFramebuffers(1, &fbo);
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	GLState::bindFramebuffer(fbo);
 	glGenTextures(1, &renderTo);
 	//Setup offscreen texture
-	glBindTexture(GL_TEXTURE_2D, renderTo);
+	GLState::bindTexture(0, GL_TEXTURE_2D, renderTo);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	GLState::bindTexture(0, GL_TEXTURE_2D, 0);
 	//Create framebuffer
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, renderTo, 0);
 	//Create render buffer
@@ -34,14 +35,13 @@ void Portal::initPortalMap() {
 	glBindRenderbuffer(GL_RENDERBUFFER, 0);
 	//Attach render buffer
 	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::bindFramebuffer(0);
 
-	glUseProgram(portal.getProgram());
-	glUniform1i(glGetUniformLocation(portal.getProgram(), "portal"), 0);
-	glUseProgram(0);
+	GLState::useProgram(portal.getProgram());
+	glUniform1i(portal.getUniformLocation("portal"), 0);
 }
 
-void Portal::render(Camera* cam, GLuint depthMap, glm::mat4& LSM) {
+void Portal::render(Camera* cam) {
 	if (renderView && portalSurface) {
 		//Set camera to be in correct relative location
 		renderView->setLocalMatrix(glm::inverse(this->getGlobalMatrix()) * cam->getGlobalMatrix());
@@ -49,17 +49,19 @@ void Portal::render(Camera* cam, GLuint depthMap, glm::mat4& LSM) {
 		//Render target camera to texture
 		renderView->render(fbo);
 		//Hack the framebuffer back
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		GLState::bindFramebuffer(0);
 		//Render portal using texture
-		glUseProgram(portal.getProgram());
+		GLState::useProgram(portal.getProgram());
 		glm::mat4 lsm = (cam->getProjection() * cam->getView());
-		glUniformMatrix4fv(glGetUniformLocation(portal.getProgram(), "lightSpaceMatrix"), 1, false, &lsm[0][0]);
+		glUniformMatrix4fv(portal.getUniform(Shader::LIGHT_SPACE_MATRIX), 1, false, &lsm[0][0]);
 		portalSurface->setLocalMatrix(this->getGlobalMatrix());
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, renderTo);
-		glDepthMask(GL_FALSE);
+		GLState::bindTexture(0, GL_TEXTURE_2D, renderTo);
+		GLState::setDepthMask(false);
 		portalSurface->renderShadow(portal.getProgram());
-		glDepthMask(GL_TRUE);
-		glUseProgram(0);
+		GLState::setDepthMask(true);
 	}
 }
+
+uint64_t Portal::getSortKey(unsigned int depth) {
+	return RenderQueue::makeKey(RenderQueue::PORTAL_PASS, portal.getProgram(), 0, 0, depth);
+}
@@ -7,8 +7,10 @@ public:
 	Portal();
 	~Portal();
 	void initPortalMap();
-	void render(Camera* cam, GLuint depthMap, glm::mat4& LSM);
+	void render(Camera* cam);
 	void renderShadow(GLuint program) {};
+	// Portals draw after everything else, since drawing the other side changes all the state
+	uint64_t getSortKey(unsigned int depth);
 	SceneObject* exitPortal;
 	Camera* renderView;
 	Model* portalSurface;
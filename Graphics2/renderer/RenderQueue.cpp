@@ -0,0 +1,68 @@
+#include "RenderQueue.h"
+#include <cmath>
+#include "glm/glm.hpp"
+
+std::map<std::array<GLuint, 4>, unsigned int> RenderQueue::materials;
+
+void RenderQueue::submit(uint64_t key, Renderable* r) {
+	Item item;
+	item.key = key;
+	item.renderable = r;
+	items.push_back(item);
+}
+
+void RenderQueue::sort() {
+	size_t n = items.size();
+	if (n < 2) {
+		return;
+	}
+	sorted.resize(n);
+	//Least significant byte first, each pass is stable so earlier passes are kept within later ones
+	for (int shift = 0; shift < 64; shift += 8) {
+		size_t counts[256] = {};
+		for (const Item& item : items) {
+			counts[(item.key >> shift) & 0xFF]++;
+		}
+		//Every key has the same byte here (common for the pass and program), nothing to move
+		if (counts[(items[0].key >> shift) & 0xFF] == n) {
+			continue;
+		}
+		size_t offset = 0;
+		for (int b = 0; b < 256; b++) {
+			size_t c = counts[b];
+			counts[b] = offset;
+			offset += c;
+		}
+		for (const Item& item : items) {
+			sorted[counts[(item.key >> shift) & 0xFF]++] = item;
+		}
+		items.swap(sorted);
+	}
+}
+
+uint64_t RenderQueue::makeKey(Pass pass, GLuint program, unsigned int material, GLuint vertexArray, unsigned int depth) {
+	return (static_cast<uint64_t>(pass & 0xF) << 60) |
+		(static_cast<uint64_t>(program & 0xFFF) << 48) |
+		(static_cast<uint64_t>(material & 0xFFFF) << 32) |
+		(static_cast<uint64_t>(vertexArray & 0xFFFF) << 16) |
+		static_cast<uint64_t>(depth & 0xFFFF);
+}
+
+unsigned int RenderQueue::getDepthBucket(float distance, float far) {
+	if (distance <= 0.0f || far <= 0.0f) {
+		return 0;
+	}
+	float d = std::log2(1.0f + distance) / std::log2(1.0f + far);
+	return static_cast<unsigned int>(glm::clamp(d, 0.0f, 1.0f) * 65535.0f);
+}
+
+unsigned int RenderQueue::getMaterialId(GLuint diffuse, GLuint specular, GLuint normal, GLuint emission) {
+	std::array<GLuint, 4> textures = { diffuse, specular, normal, emission };
+	std::map<std::array<GLuint, 4>, unsigned int>::iterator it = materials.find(textures);
+	if (it != materials.end()) {
+		return it->second;
+	}
+	unsigned int id = static_cast<unsigned int>(materials.size());
+	materials[textures] = id;
+	return id;
+}
@@ -0,0 +1,52 @@
+#pragma once
+/*
+A list of draws for one pass of a camera, ordered by a packed 64 bit key so draws
+sharing a program, textures and vertex array end up next to each other.
+From the most to least significant bits a key holds:
+pass (4), program (12), material (16), vertex array (16), depth bucket (16)
+Opaque draws within the same state are ordered front to back, so early depth
+testing can throw away hidden fragments.
+*/
+#include <vector>
+#include <map>
+#include <array>
+#include <cstdint>
+#include "OpenGLSetup.h"
+
+class Renderable;
+
+class RenderQueue {
+public:
+	//Passes are drawn in this order
+	enum Pass {
+		OPAQUE_PASS,
+		//Portals draw another scene, so go after everything that can share state
+		PORTAL_PASS
+	};
+	struct Item {
+		uint64_t key;
+		Renderable* renderable;
+	};
+	// Removes every draw from the queue
+	void clear() { items.clear(); };
+	// Adds a draw to the queue
+	void submit(uint64_t key, Renderable* r);
+	// Sorts the draws by key (radix sort, so linear in the number of draws)
+	void sort();
+	const std::vector<Item>& getItems() const { return items; };
+	size_t size() const { return items.size(); };
+	// Packs the state of a draw into a key, fields too large for their bits are wrapped
+	static uint64_t makeKey(Pass pass, GLuint program, unsigned int material, GLuint vertexArray, unsigned int depth);
+	// Gets the pass a key was made for
+	static Pass getPass(uint64_t key) { return static_cast<Pass>(key >> 60); };
+	// Converts a distance from the camera into a depth bucket (logarithmic, so planets and
+	// nearby objects both get useful ordering)
+	static unsigned int getDepthBucket(float distance, float far);
+	// Gets a small id for a set of textures, the same set always gets the same id
+	static unsigned int getMaterialId(GLuint diffuse, GLuint specular, GLuint normal, GLuint emission);
+private:
+	std::vector<Item> items;
+	//Scratch space for sorting
+	std::vector<Item> sorted;
+	static std::map<std::array<GLuint, 4>, unsigned int> materials;
+};
@@ -3,10 +3,24 @@
 
 
 Renderable::Renderable() {
+	boundsSet = false;
+	boundsDirty = true;
+	boundsVersion = 0;
+	visible = true;
+	occluder = false;
+	staticCaster = false;
 }
 
 
 Renderable::~Renderable() {
+	//Don't leave a dangling pointer in the scene's draw list
+	if (getScene()) {
+		getScene()->renderables.erase(this);
+		if (staticCaster) {
+			Scene* s = getScene();
+			invalidateStaticShadows(s, glm::inverse(s->getStaticRoot()->getGlobalMatrix()) * getGlobalMatrix());
+		}
+	}
 }
 
 void Renderable::setScene(Scene* s) {
@@ -20,5 +34,71 @@ void Renderable::setScene(Scene* s) {
 		if (s) {
 			s->renderables.insert(this);
 		}
+		//Static shadows of both scenes are out of date where the renderable was and now is
+		if (staticCaster) {
+			if (old) {
+				//The global matrix isn't moved to the new parent until after this, so still says where it was
+				invalidateStaticShadows(old, glm::inverse(old->getStaticRoot()->getGlobalMatrix()) * getGlobalMatrix());
+			}
+			if (s) {
+				invalidateStaticShadows(s, getMatrixToRoot(s));
+			}
+		}
+	}
+}
+
+void Renderable::setLocalBounds(const AABB& bounds) {
+	localBounds = bounds;
+	boundsSet = true;
+	boundsDirty = true;
+}
+
+const AABB& Renderable::getWorldBounds() {
+	uint64_t current = getTransformVersion();
+	if (boundsDirty || boundsVersion != current) {
+		worldBounds = localBounds.transform(getGlobalMatrix());
+		boundsVersion = current;
+		boundsDirty = false;
+	}
+	return worldBounds;
+}
+
+void Renderable::setStatic(bool isStatic) {
+	if (isStatic != staticCaster && getScene()) {
+		invalidateStaticShadows(getScene(), getMatrixToRoot(getScene()));
+	}
+	staticCaster = isStatic;
+}
+
+void Renderable::invalidateStaticShadows(Scene* s, const glm::mat4& toRoot) {
+	if (!boundsSet) {
+		s->invalidateStaticShadows();
+		return;
+	}
+	AABB b = localBounds.transform(toRoot);
+	s->invalidateStaticShadows(b.getCentre(), glm::length(b.getExtents()));
+}
+
+glm::mat4 Renderable::getMatrixToRoot(Scene* s) {
+	SceneObject* root = s->getStaticRoot();
+	glm::mat4 m = getLocalMatrix();
+	for (SceneObject* p = getParent(); p; p = p->getParent()) {
+		//Stopping at the root keeps its (possibly huge) offset out of the result
+		if (p == root) {
+			return m;
+		}
+		m = p->getLocalMatrix() * m;
+	}
+	return glm::inverse(root->getGlobalMatrix()) * m;
+}
+
+uint64_t Renderable::getSortKey(unsigned int depth) {
+	return RenderQueue::makeKey(RenderQueue::OPAQUE_PASS, shader.getProgram(), 0, 0, depth);
+}
+
+bool Renderable::inFrustum(const Frustum& f) {
+	if (!boundsSet) {
+		return true;
 	}
+	return f.intersectsBox(getWorldBounds());
 }
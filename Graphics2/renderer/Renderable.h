@@ -6,16 +6,57 @@ Meshes are an obvious example of this.
 #include "SceneObject.h"
 #include "Camera.h"
 #include "Shader.h"
+#include "Bounds.h"
+#include "Frustum.h"
+#include "OcclusionBuffer.h"
+#include "RenderQueue.h"
 class Renderable :
 	public SceneObject {
 public:
 	Renderable();
 	virtual ~Renderable();
-	virtual void render(Camera* cam, GLuint depthMap, glm::mat4& LSM) = 0;
+	virtual void render(Camera* cam) = 0;
 	virtual void renderShadow(GLuint p) = 0;
+	// Gets the key the renderable is sorted by in a render queue, depth is the bucket of its distance from the camera
+	virtual uint64_t getSortKey(unsigned int depth);
+	// Sets the bounding box of the renderable in its local space
+	void setLocalBounds(const AABB& bounds);
+	// Gets the bounding box of the renderable in its local space
+	const AABB& getLocalBounds() const { return localBounds; };
+	// Gets the bounding box in scene space, recalculated only after the object moves
+	const AABB& getWorldBounds();
+	// Whether bounds have been set, renderables without them are never culled
+	bool hasBounds() const { return boundsSet; };
+	// Checks if the renderable could be seen by the frustum
+	bool inFrustum(const Frustum& f);
+	// Sets whether the renderable is drawn, without removing it from the scene
+	// Static renderables still cast shadows while hidden, they only stop once they leave the scene
+	void setVisible(bool visible) { this->visible = visible; };
+	// Gets whether the renderable is drawn
+	bool isVisible() const { return visible; };
+	// Sets whether the renderable stays still relative to the scene's static root, so its shadow can be cached
+	void setStatic(bool isStatic);
+	// Gets whether the renderable's shadow can be cached
+	bool isStatic() const { return staticCaster; };
+	// Draws the renderable into a software depth buffer, to hide things behind it
+	virtual void rasterizeOccluder(OcclusionBuffer& buffer) {};
+	// Whether the renderable is large and solid enough to be used to hide other things
+	bool occluder;
 protected:
 	Shader shader;
 private:
 	void setScene(Scene* s);
+	//Marks the scene's cached shadows around the renderable as out of date, toRoot maps it into the static root's space
+	void invalidateStaticShadows(Scene* s, const glm::mat4& toRoot);
+	//Gets the matrix into the scene's static root's space by following the parents, which are updated before the global matrix
+	glm::mat4 getMatrixToRoot(Scene* s);
+	AABB localBounds;
+	AABB worldBounds;
+	bool boundsSet;
+	bool boundsDirty;
+	//Transform version the world bounds were calculated with
+	uint64_t boundsVersion;
+	bool visible;
+	bool staticCaster;
 };
 
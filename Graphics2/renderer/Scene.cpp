@@ -1,47 +1,68 @@
 #include "Scene.h"
 #include <stb_image.h>
+#include <cstring>
+#include <limits>
+#include "GLState.h"
 
+//How many changes to static renderables are remembered, cached shadows older than that are all redrawn
+#define MAX_STATIC_CHANGES 256
+
+Scene* Scene::boundLights = NULL;
 
 Scene::Scene() {
 	ambientLight = glm::vec3(0.2f, 0.2f, 0.2f);
 	skyColour = glm::vec3(33.0f / 255.0f, 120.0f / 255.0f, 224.0f / 255.0f);
 	skyAmount = 0.0f;
+	occluderAnchor = NULL;
+	occluderRadius = 0.0f;
+	staticRoot = NULL;
+	staticVersion = 0;
 	//Skybox related things
 	skybox = 0;
 	skyboxShader = Shader("shaders/skybox.vert", "shaders/skybox.frag");
 	meshShader = Shader("shaders/multiLight.vert", "shaders/multiLight.frag");
+	//Light buffer, filled in by updateLights
+	glGenBuffers(1, &lightBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, lightBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(LightBlock), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	lightDataValid = false;
 	glGenVertexArrays(1, &vertexArray);
-	glBindVertexArray(vertexArray);
+	GLState::bindVertexArray(vertexArray);
 	glGenBuffers(1, &vertexBuffer);
 	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(vertexData), &vertexData, GL_STATIC_DRAW);
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void*)0);
-	viewUniform = glGetUniformLocation(skyboxShader.getProgram(), "view");
-	projUniform = glGetUniformLocation(skyboxShader.getProgram(), "projection");
-	cubeSampler = glGetUniformLocation(skyboxShader.getProgram(), "skybox");
-	skyColourUniform = glGetUniformLocation(skyboxShader.getProgram(), "skyColour");
-	skyAmountUniform = glGetUniformLocation(skyboxShader.getProgram(), "skyAmount");
-	glBindVertexArray(0);
+	viewUniform = skyboxShader.getUniform(Shader::VIEW);
+	projUniform = skyboxShader.getUniform(Shader::PROJECTION);
+	cubeSampler = skyboxShader.getUniformLocation("skybox");
+	skyColourUniform = skyboxShader.getUniformLocation("skyColour");
+	skyAmountUniform = skyboxShader.getUniformLocation("skyAmount");
+	GLState::bindVertexArray(0);
 }
 
 
 Scene::~Scene() {
 	if (skybox) {
-		glDeleteTextures(1, &skybox);
+		GLState::deleteTexture(skybox);
 	}
-	glDeleteVertexArrays(1, &vertexArray);
+	GLState::deleteVertexArray(vertexArray);
 	glDeleteBuffers(1, &vertexBuffer);
+	glDeleteBuffers(1, &lightBuffer);
+	if (boundLights == this) {
+		boundLights = NULL;
+	}
 }
 
 void Scene::loadSkybox(string posX, string negX, string posY, string negY, string posZ, string negZ) {
 	if (skybox) {
-		glDeleteTextures(1, &skybox);
+		GLState::deleteTexture(skybox);
 		skybox = 0;
 	}
 	stbi_set_flip_vertically_on_load(false);
 	glGenTextures(1, &skybox);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, skybox);
+	GLState::bindTexture(0, GL_TEXTURE_CUBE_MAP, skybox);
 	int width, height, channels;
 	unsigned char* data = stbi_load(posX.c_str(), &width, &height, &channels, 0);
 	glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_RGB, width, height, 0, GL_RGB,
@@ -80,8 +101,8 @@ void Scene::loadSkybox(string posX, string negX, string posY, string negY, strin
 void Scene::renderSkybox(Camera* c) {
 	if (skybox) {
 		//Set shaders
-		glUseProgram(skyboxShader.getProgram());
-		glDepthFunc(GL_LEQUAL);
+		GLState::useProgram(skyboxShader.getProgram());
+		GLState::setDepthFunc(GL_LEQUAL);
 		glUniform1i(cubeSampler, 0);
 		glUniform1f(skyAmountUniform, skyAmount);
 		glUniform3fv(skyColourUniform, 1, &skyColour[0]);
@@ -90,54 +111,106 @@ void Scene::renderSkybox(Camera* c) {
 		glm::mat4 proj = c->getProjection();
 		glUniformMatrix4fv(viewUniform, 1, GL_FALSE, &view[0][0]);
 		glUniformMatrix4fv(projUniform, 1, GL_FALSE, &proj[0][0]);
-		glBindVertexArray(vertexArray);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, skybox);
+		GLState::bindVertexArray(vertexArray);
+		GLState::bindTexture(0, GL_TEXTURE_CUBE_MAP, skybox);
 		glDrawArrays(GL_TRIANGLES, 0, 36);
-		glDepthFunc(GL_LESS);
+		GLState::setDepthFunc(GL_LESS);
 	}
 }
 
 void Scene::updateLights() {
-	GLuint program = meshShader.getProgram();
-	glUniform3fv(glGetUniformLocation(program, "ambient"), 1, &ambientLight[0]);
+	LightBlock block;
+	//Cleared so padding and unused lights compare equal between frames
+	memset(&block, 0, sizeof(block));
+	block.ambient = ambientLight;
 	//Update directional light
 	if (dirLight) {
-		glm::vec3 dir = glm::vec3(dirLight->getGlobalMatrix() * glm::vec4(dirLight->direction, 1.0f));
-		glUniform3fv(glGetUniformLocation(program, "dirLight.direction"), 1, &dir[0]);
-		glUniform3fv(glGetUniformLocation(program, "dirLight.colour"), 1, &dirLight->colour[0]);
+		block.dirLight.direction = glm::vec3(dirLight->getGlobalMatrix() * glm::vec4(dirLight->direction, 1.0f));
+		block.dirLight.colour = dirLight->colour;
 	}
-	glUniform1i(glGetUniformLocation(program, "numDirLights"), dirLight ? 1 : 0);
-	//Update point lights
-	int i = 0;
-	for (PointLight* p : pointLights) {
-		glm::mat4 mat = p->getGlobalMatrix();
-		glUniform3fv(glGetUniformLocation(program, ("pointLights[" + std::to_string(i) + "].position").c_str()), 1, &mat[3][0]);
-		glUniform3fv(glGetUniformLocation(program, ("pointLights[" + std::to_string(i) + "].colour").c_str()), 1, &p->colour[0]);
-		glUniform1f(glGetUniformLocation(program,  ("pointLights[" + std::to_string(i) + "].quadratic").c_str()), p->quadratic);
-		glUniform1f(glGetUniformLocation(program,  ("pointLights[" + std::to_string(i) + "].linear").c_str()), p->linear);
-		glUniform1f(glGetUniformLocation(program,  ("pointLights[" + std::to_string(i) + "].constant").c_str()), p->constant);
-		i++;
+	block.numDirLights = dirLight ? 1 : 0;
+	//Nothing to send if no light has changed since the last frame
+	if (!lightDataValid || memcmp(&block, &lightData, sizeof(block)) != 0) {
+		lightData = block;
+		lightDataValid = true;
+		glBindBuffer(GL_UNIFORM_BUFFER, lightBuffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(block), &block);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
 	}
-	glUniform1i(glGetUniformLocation(program, "numPointLights"), pointLights.size());
-	//Update spotlights
-	i = 0;
-	for (SpotLight* s : spotLights) {
-		glm::mat4 mat = s->getGlobalMatrix();
-		glm::vec3 dir = glm::vec3(glm::mat3(mat) * s->direction);
-		glUniform3fv(glGetUniformLocation(program, ("spotLights[" + std::to_string(i) + "].position").c_str()), 1, &mat[3][0]);
-		glUniform3fv(glGetUniformLocation(program, ("spotLights[" + std::to_string(i) + "].direction").c_str()), 1, &dir[0]);
-		glUniform3fv(glGetUniformLocation(program, ("spotLights[" + std::to_string(i) + "].colour").c_str()), 1, &s->colour[0]);
-		glUniform1f(glGetUniformLocation(program,  ("spotLights[" + std::to_string(i) + "].quadratic").c_str()), s->quadratic);
-		glUniform1f(glGetUniformLocation(program,  ("spotLights[" + std::to_string(i) + "].linear").c_str()), s->linear);
-		glUniform1f(glGetUniformLocation(program,  ("spotLights[" + std::to_string(i) + "].constant").c_str()), s->constant);
-		glUniform1f(glGetUniformLocation(program,  ("spotLights[" + std::to_string(i) + "].cutOff").c_str()), s->cutOff);
-		glUniform1f(glGetUniformLocation(program,  ("spotLights[" + std::to_string(i) + "].outerCutOff").c_str()), s->outerCutOff);
-		i++;
+	bindLights();
+}
+
+void Scene::bindLights() {
+	//Another scene may have been drawn in between (eg through a portal)
+	if (boundLights != this) {
+		glBindBufferBase(GL_UNIFORM_BUFFER, Shader::LIGHTS_BLOCK, lightBuffer);
+		boundLights = this;
+	}
+	if (dirLight) {
+		dirLight->getShadowMap().bind();
 	}
-	glUniform1i(glGetUniformLocation(program, "numSpotLights"), spotLights.size());
 }
 
 DirectionalLight* Scene::getDirectionalLight() {
 	return dirLight;
 }
+
+void Scene::setOccluder(SceneObject* anchor, float radius) {
+	occluderAnchor = anchor;
+	occluderRadius = radius;
+}
+
+void Scene::setStaticRoot(SceneObject* root) {
+	if (root != staticRoot) {
+		staticRoot = root;
+		invalidateStaticShadows();
+	}
+}
+
+void Scene::invalidateStaticShadows(const glm::vec3& centre, float radius) {
+	staticChanges.push_back(glm::vec4(centre, radius));
+	if (staticChanges.size() > MAX_STATIC_CHANGES) {
+		staticChanges.pop_front();
+	}
+	staticVersion++;
+}
+
+void Scene::invalidateStaticShadows() {
+	invalidateStaticShadows(glm::vec3(0.0f), std::numeric_limits<float>::infinity());
+}
+
+bool Scene::getStaticChanges(uint64_t since, std::vector<glm::vec4>& changes) const {
+	uint64_t count = staticVersion - since;
+	if (count > staticChanges.size()) {
+		return false;
+	}
+	changes.insert(changes.end(), staticChanges.end() - static_cast<size_t>(count), staticChanges.end());
+	return true;
+}
+
+Horizon Scene::getHorizon(glm::vec3 viewPos) {
+	if (!occluderAnchor) {
+		return Horizon();
+	}
+	return Horizon(viewPos, occluderAnchor->getGlobalPosition(), occluderRadius);
+}
+
+void Scene::cullLights(const Frustum& f, const Horizon& h) {
+	//A light only matters if its area of effect can be seen
+	visiblePointLights.clear();
+	for (PointLight* p : pointLights) {
+		glm::vec3 pos = glm::vec3(p->getGlobalMatrix()[3]);
+		float range = p->getRange();
+		if (f.intersectsSphere(pos, range) && !h.isHidden(pos, range)) {
+			visiblePointLights.push_back(p);
+		}
+	}
+	visibleSpotLights.clear();
+	for (SpotLight* s : spotLights) {
+		glm::vec3 pos = glm::vec3(s->getGlobalMatrix()[3]);
+		float range = s->getRange();
+		if (f.intersectsSphere(pos, range) && !h.isHidden(pos, range)) {
+			visibleSpotLights.push_back(s);
+		}
+	}
+}
@@ -4,13 +4,17 @@ A scene is everything that is rendered, multiple scenes can be rendered at once
 by combining multiple cameras (example use for this is drawing planets with one
 scene and local objects like spaceships with another)
 */
+#include <deque>
 #include <set>
 #include <string>
+#include <vector>
 #include "SceneObject.h"
 #include "Renderable.h"
 #include "DirectionalLight.h"
 #include "PointLight.h"
 #include "SpotLight.h"
+#include "Frustum.h"
+#include "Horizon.h"
 
 using std::string;
 using std::set;
@@ -19,11 +23,39 @@ class Scene: public SceneObject{
 public:
 	Scene();
 	~Scene();
+	Scene* asScene() { return this; };
 	const set<Renderable*>& getRenderables() { return renderables; };
 	void loadSkybox(string posX, string negX, string posY, string negY, string posZ, string negZ);
 	void renderSkybox(Camera* c);
+	// Packs the directional and ambient light into the scene's uniform buffer, only uploading if they changed
+	// Point and spot lights are binned per camera instead (see LightClusters)
 	void updateLights();
+	// Binds the scene's light buffer and the directional light's shadows for the mesh shader
+	void bindLights();
 	DirectionalLight* getDirectionalLight();
+	// Sets a sphere (centred on anchor) that hides anything behind it, eg a planet
+	void setOccluder(SceneObject* anchor, float radius);
+	// Gets the horizon of the scene's occluder as seen from viewPos
+	Horizon getHorizon(glm::vec3 viewPos);
+	// Picks the lights that can reach anything inside the frustum and above the horizon
+	void cullLights(const Frustum& f, const Horizon& h);
+	// Sets the object static renderables are fixed relative to (the scene itself by default)
+	// Shadows of static renderables are cached in its space, so it can move without them being redrawn
+	void setStaticRoot(SceneObject* root);
+	// Gets the object static renderables are fixed relative to
+	SceneObject* getStaticRoot() { return staticRoot ? staticRoot : this; };
+	// Marks cached shadows of static renderables within a sphere (in the static root's space) as out of date
+	// Needed after adding, removing or moving one relative to the root, Renderable does it for the first two
+	void invalidateStaticShadows(const glm::vec3& centre, float radius);
+	// Marks every cached shadow of static renderables as out of date
+	void invalidateStaticShadows();
+	// Gets a number that goes up with every change to the static renderables
+	uint64_t getStaticVersion() const { return staticVersion; };
+	// Gets the spheres (xyz centre, w radius) changed since a version, false if that is too long ago to still know
+	bool getStaticChanges(uint64_t since, std::vector<glm::vec4>& changes) const;
+	// Gets the lights picked by the last cullLights
+	const std::vector<PointLight*>& getVisiblePointLights() const { return visiblePointLights; };
+	const std::vector<SpotLight*>& getVisibleSpotLights() const { return visibleSpotLights; };
 	glm::vec3 ambientLight;
 	glm::vec3 skyColour;
 	float skyAmount;
@@ -33,6 +65,15 @@ private:
 	DirectionalLight* dirLight;
 	set<PointLight*> pointLights;
 	set<SpotLight*> spotLights;
+	//Lights picked by the last cullLights
+	std::vector<PointLight*> visiblePointLights;
+	std::vector<SpotLight*> visibleSpotLights;
+	SceneObject* occluderAnchor;
+	float occluderRadius;
+	SceneObject* staticRoot;
+	uint64_t staticVersion;
+	//Latest changes to the static renderables, the last one is staticVersion
+	std::deque<glm::vec4> staticChanges;
 	friend Renderable;
 	friend DirectionalLight;
 	friend PointLight;
@@ -40,6 +81,25 @@ private:
 	GLuint skybox;
 	Shader skyboxShader;
 	Shader meshShader;
+	//The Lights block of multiLight.frag, laid out std140 (vec3s are padded to 16 bytes)
+	struct DirectionalLightData {
+		glm::vec3 direction;
+		float pad0;
+		glm::vec3 colour;
+		float pad1;
+	};
+	struct LightBlock {
+		DirectionalLightData dirLight;
+		glm::vec3 ambient;
+		GLint numDirLights;
+	};
+	static_assert(sizeof(LightBlock) == 48, "LightBlock must match the std140 layout of the Lights block");
+	//Light data last uploaded to lightBuffer
+	LightBlock lightData;
+	bool lightDataValid;
+	GLuint lightBuffer;
+	//Scene whose light buffer is bound to the Lights binding point
+	static Scene* boundLights;
 	GLuint vertexArray;
 	GLuint vertexBuffer;
 	GLuint viewUniform;
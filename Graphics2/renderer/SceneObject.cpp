@@ -1,35 +1,45 @@
 #include "SceneObject.h"
 #include <iostream>
-#include "glm/gtc/matrix_transform.hpp"
-#include "glm/gtc/quaternion.hpp"
-#define GLM_ENABLE_EXPERIMENTAL
-#include "glm/gtx/matrix_decompose.hpp"
 #include "Scene.h"
 
 SceneObject::SceneObject() {
-	localMat = glm::mat4(1);
-	globalMat = glm::mat4(1);
 	parent = nullptr;
+	firstChild = nullptr;
+	nextSibling = nullptr;
+	prevSibling = nullptr;
 	scene = nullptr;
-	pos = glm::vec3(0.0);
-	scale = glm::vec3(1.0);
-	rot = glm::quat(glm::vec3(0.0f, 0.0f, 0.0f));
+	transform = TransformSystem::create();
 }
 
 SceneObject::SceneObject(SceneObject& other) {
+	parent = nullptr;
+	firstChild = nullptr;
+	nextSibling = nullptr;
+	prevSibling = nullptr;
+	scene = nullptr;
+	transform = TransformSystem::create();
 }
 
 
 SceneObject::~SceneObject() {
+	//Don't leave dangling links in the parent or children
+	unlink();
+	SceneObject* c = firstChild;
+	while (c) {
+		SceneObject* next = c->nextSibling;
+		c->parent = nullptr;
+		c->prevSibling = nullptr;
+		c->nextSibling = nullptr;
+		c = next;
+	}
+	TransformSystem::destroy(transform);
 }
 
 bool SceneObject::setParent(Scene* obj) {
 	if (!obj) {
 		return false;
 	}
-	this->parent = (SceneObject*)obj;
-	setScene(obj);
-	return true;
+	return setParent(static_cast<SceneObject*>(obj));
 }
 
 
@@ -39,127 +49,129 @@ bool SceneObject::setParent(SceneObject* obj) {
 		std::cerr << "Circular reference in object hierarchy" << std::endl;
 		throw;
 	}
+	if (obj == this->parent) {
+		return true;
+	}
+	unlink();
+	Scene* newScene = NULL;
 	if (obj) {
-		obj->children.insert(this);
-		//Ensure correct scene
-		if (dynamic_cast<Scene*>(obj)) {
-			setScene(dynamic_cast<Scene*>(obj));
-		} else {
-			setScene(obj->scene);
+		//Add to the front of the new parent's children
+		this->nextSibling = obj->firstChild;
+		if (obj->firstChild) {
+			obj->firstChild->prevSibling = this;
 		}
-	} else {
-		if (this->parent) {
-			this->parent->children.erase(this);
-		}
-		setScene(NULL);
+		obj->firstChild = this;
+		//Ensure correct scene
+		newScene = obj->asScene() ? obj->asScene() : obj->scene;
 	}
 	this->parent = obj;
+	//Moving within the same scene doesn't need the whole subtree visiting
+	if (newScene != this->scene) {
+		setScene(newScene);
+	}
+	//Global matrix depends on the new parent
+	TransformSystem::setParent(transform, obj ? obj->transform : TransformSystem::INVALID);
 	return true;
 }
 
 bool SceneObject::hasChild(SceneObject* child) {
-	for (SceneObject* s : this->children) {
-		if (s == child) {
+	return child && child->parent == this;
+}
+
+bool SceneObject::hasDescendent(SceneObject* child) {
+	//Walk up from the child rather than searching the whole subtree
+	for (SceneObject* s = child ? child->parent : NULL; s; s = s->parent) {
+		if (s == this) {
 			return true;
 		}
 	}
 	return false;
 }
 
-bool SceneObject::hasDescendent(SceneObject* child) {
-	if (hasChild(child)) {
-		return true;
+void SceneObject::unlink() {
+	if (!this->parent) {
+		return;
 	}
-	for (SceneObject* s : this->children) {
-		if (s->hasDescendent(child)) {
-			return true;
-		}
+	if (this->prevSibling) {
+		this->prevSibling->nextSibling = this->nextSibling;
+	} else {
+		this->parent->firstChild = this->nextSibling;
 	}
-	return false;
+	if (this->nextSibling) {
+		this->nextSibling->prevSibling = this->prevSibling;
+	}
+	this->prevSibling = nullptr;
+	this->nextSibling = nullptr;
+	this->parent = nullptr;
 }
 
 void SceneObject::setLocalMatrix(glm::mat4 local) {
-	localMat = local;
-	updateMatrix();
-	glm::vec3 skew;
-	glm::vec4 pers;
-	glm::decompose(localMat, scale, rot, pos, skew, pers);
+	TransformSystem::setLocalMatrix(transform, local);
 }
 
 glm::mat4 SceneObject::getLocalMatrix() {
-	return localMat;
+	return TransformSystem::getLocalMatrix(transform);
 }
 
 glm::mat4 SceneObject::getGlobalMatrix() {
-	return globalMat;
+	return TransformSystem::getGlobalMatrix(transform);
 }
 
 void SceneObject::setPosition(glm::vec3 pos) {
-	this->pos = pos;
-	//Apply transformations in order: rotation, scale, translation
-	localMat = glm::translate(glm::mat4(1.0f), pos) * glm::scale(glm::mat4(1.0f), scale) * glm::mat4_cast(rot);
-	updateMatrix();
+	TransformSystem::setPosition(transform, glm::dvec3(pos));
+}
+
+void SceneObject::setPosition(glm::dvec3 pos) {
+	TransformSystem::setPosition(transform, pos);
 }
 
 void SceneObject::setScale(glm::vec3 scale) {
-	this->scale = scale;
-	//Apply transformations in order: rotation, scale, translation
-	localMat = glm::translate(glm::mat4(1.0f), pos) * glm::scale(glm::mat4(1.0f), scale) * glm::mat4_cast(rot);
-	updateMatrix();
+	TransformSystem::setScale(transform, scale);
 }
 
 void SceneObject::setRotation(glm::quat rot) {
-	this->rot = rot;
-	//Apply transformations in order: rotation, scale, translation
-	localMat = glm::translate(glm::mat4(1.0f), pos) * glm::scale(glm::mat4(1.0f), scale) * glm::mat4_cast(rot);
-	updateMatrix();
+	TransformSystem::setRotation(transform, rot);
 }
 
 glm::vec3 SceneObject::getPosition() {
-	return pos;
+	return glm::vec3(TransformSystem::getPosition(transform));
+}
+
+glm::dvec3 SceneObject::getPrecisePosition() {
+	return TransformSystem::getPosition(transform);
 }
 
 glm::vec3 SceneObject::getScale() {
-	return scale;
+	return TransformSystem::getScale(transform);
 }
 
 glm::quat SceneObject::getRotation() {
-	return rot;
+	return TransformSystem::getRotation(transform);
 }
 
 glm::vec3 SceneObject::getFront() {
-	return glm::normalize(glm::mat3(localMat) * glm::vec3(0.0, 0.0, -1.0));
+	return glm::normalize(glm::mat3(getLocalMatrix()) * glm::vec3(0.0, 0.0, -1.0));
 }
 
 glm::vec3 SceneObject::getUp() {
-	return glm::normalize(glm::mat3(localMat) * glm::vec3(0.0, 1.0, 0.0));
+	return glm::normalize(glm::mat3(getLocalMatrix()) * glm::vec3(0.0, 1.0, 0.0));
 }
 
 glm::vec3 SceneObject::getRight() {
-	return glm::normalize(glm::mat3(localMat) * glm::vec3(1.0, 0.0, 0.0));
+	return glm::normalize(glm::mat3(getLocalMatrix()) * glm::vec3(1.0, 0.0, 0.0));
 }
 
 glm::vec3 SceneObject::getGlobalPosition() {
-	return glm::vec3(globalMat[3]);
+	return glm::vec3(getGlobalMatrix()[3]);
 }
 
-void SceneObject::updateMatrix() {
-	//Technically the scene can be transformed, and it lacks a parent
-	if (this->parent) {
-		//Apply local transformation, then parent, then parent's parent, etc
-		this->globalMat = this->parent->getGlobalMatrix() * localMat;
-	} else {
-		this->globalMat = localMat;
-	}
-	//Update child matrices
-	for (SceneObject* o : this->getChildren()) {
-		o->updateMatrix();
-	}
+glm::dvec3 SceneObject::getPreciseGlobalPosition() {
+	return TransformSystem::getGlobalPosition(transform);
 }
 
 void SceneObject::setScene(Scene* s) {
 	this->scene = s;
-	for (SceneObject* c : children) {
+	for (SceneObject* c = firstChild; c; c = c->nextSibling) {
 		c->setScene(s);
 	}
 }
@@ -7,10 +7,10 @@ For example these can be:
 -The scene itself, technically
 -Grouping objects
 */
-#include <unordered_set>
+#include <cstdint>
 #include "glm/glm.hpp"
 #include "glm/gtc/quaternion.hpp"
-using std::unordered_set;
+#include "TransformSystem.h"
 class Scene;
 
 class SceneObject {
@@ -26,26 +26,34 @@ public:
 	SceneObject* getParent() { return parent; };
 	//Gets the scene the object occupies
 	Scene* getScene() { return scene; };
-	//Gets the children of the object
-	const unordered_set<SceneObject*>& getChildren() const { return children; };
+	//Gets the first child of the object, the rest are reached through getNextSibling
+	SceneObject* getFirstChild() { return firstChild; };
+	//Gets the next child of the object's parent
+	SceneObject* getNextSibling() { return nextSibling; };
 	//Checks if the child is a direct child of the object
 	bool hasChild(SceneObject* child);
-	//Checks if the child is a descendent of the object
+	//Checks if the child is a descendent of the object, by walking up from the child
 	bool hasDescendent(SceneObject* child);
+	//Gets the object as a scene, or NULL if it isn't one
+	virtual Scene* asScene() { return NULL; };
 	//Sets the local transformation matrix
 	void setLocalMatrix(glm::mat4 local);
 	//Gets the transformation matrix local to this object
 	glm::mat4 getLocalMatrix();
 	//Gets the transformation matrix in relation to the scene
+	//Only recalculated if this object or one of its ancestors has moved since the last update
 	glm::mat4 getGlobalMatrix();
 	//Sets the position of the object
 	void setPosition(glm::vec3 pos);
+	//Sets the position of the object in double precision, for things far from the origin
+	void setPosition(glm::dvec3 pos);
 	//Sets the scale of the object
 	void setScale(glm::vec3 scale);
 	//Sets the rotation of the object
 	void setRotation(glm::quat rot);
 	//Gets the postion of the object
 	glm::vec3 getPosition();
+	glm::dvec3 getPrecisePosition();
 	//Gets the scale of the object
 	glm::vec3 getScale();
 	//Gets the rotation of the object
@@ -56,18 +64,22 @@ public:
 	glm::vec3 getRight();
 	//Gets the global position of the object
 	glm::vec3 getGlobalPosition();
+	glm::dvec3 getPreciseGlobalPosition();
+	//Gets a number that changes every time the global matrix is recalculated
+	uint64_t getTransformVersion() { return TransformSystem::getVersion(transform); };
 
 protected:
 	virtual void setScene(Scene* s);
 private:
 	Scene* scene;
 	SceneObject* parent;
-	unordered_set<SceneObject*> children;
-	glm::vec3 pos;
-	glm::vec3 scale;
-	glm::quat rot;
-	glm::mat4 localMat;
-	glm::mat4 globalMat;
-	void updateMatrix();
+	//Children are kept in an intrusive doubly linked list
+	SceneObject* firstChild;
+	SceneObject* nextSibling;
+	SceneObject* prevSibling;
+	//Removes the object from its parent's children
+	void unlink();
+	//The position, scale, rotation and matrices live in the transform system
+	TransformSystem::Handle transform;
 };
 
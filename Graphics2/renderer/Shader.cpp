@@ -4,14 +4,39 @@
 #include <vector>
 
 std::map<std::string, GLuint> Shader::shaders;
+std::unordered_map<GLuint, Shader::Reflection> Shader::reflections;
+//Must match the order of Shader::Uniform
+const char* Shader::uniformNames[UNIFORM_COUNT] = {
+	"model",
+	"view",
+	"projection",
+	"transInvModel",
+	"viewPos",
+	"lightSpaceMatrix",
+	"shininess",
+	"useNormalTexture",
+	"positionOffset",
+	"positionScale",
+	"uvOffset",
+	"uvScale"
+};
+//Must match the order of Shader::Block
+const char* Shader::blockNames[BLOCK_COUNT] = {
+	"Lights",
+	"Clusters",
+	"Shadows"
+};
 
 Shader::Shader() {
 	id = -1;
+	reflection = NULL;
 }
 
 Shader::Shader(std::string vert, std::string frag) {
+	reflection = NULL;
 	if (shaders.size() > 0 && (shaders.count(vert + frag))) {
 		id = shaders[vert + frag];
+		reflection = &reflections[id];
 	} else {
 		std::string vertString = readFile(vert);
 		std::string fragString = readFile(frag);
@@ -60,10 +85,84 @@ Shader::Shader(std::string vert, std::string frag) {
 			glDeleteShader(vertex);
 			glDeleteShader(fragment);
 			shaders.insert_or_assign(vert + frag, id);
+			reflect();
 		}
 	}
 }
 
+void Shader::reflect() {
+	Reflection& r = reflections[id];
+	GLint count = 0;
+	GLint maxLength = 0;
+	//Uniforms, arrays are only reported by their first element so the rest are added by hand
+	glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	std::vector<char> name(maxLength + 1);
+	for (GLint i = 0; i < count; i++) {
+		GLint size;
+		GLenum type;
+		GLsizei length;
+		glGetActiveUniform(id, i, maxLength + 1, &length, &size, &type, &name[0]);
+		std::string n(&name[0], length);
+		GLint location = glGetUniformLocation(id, n.c_str());
+		r.uniforms[n] = location;
+		if (n.size() > 3 && n.compare(n.size() - 3, 3, "[0]") == 0) {
+			std::string base = n.substr(0, n.size() - 3);
+			r.uniforms[base] = location;
+			for (GLint e = 1; e < size; e++) {
+				std::string element = base + "[" + std::to_string(e) + "]";
+				r.uniforms[element] = glGetUniformLocation(id, element.c_str());
+			}
+		}
+	}
+	//Attributes
+	glGetProgramiv(id, GL_ACTIVE_ATTRIBUTES, &count);
+	glGetProgramiv(id, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+	name.resize(maxLength + 1);
+	for (GLint i = 0; i < count; i++) {
+		GLint size;
+		GLenum type;
+		GLsizei length;
+		glGetActiveAttrib(id, i, maxLength + 1, &length, &size, &type, &name[0]);
+		std::string n(&name[0], length);
+		r.attributes[n] = glGetAttribLocation(id, n.c_str());
+	}
+	//Uniform blocks, so one buffer bound to a binding point feeds every program using the block
+	for (int b = 0; b < BLOCK_COUNT; b++) {
+		GLuint index = glGetUniformBlockIndex(id, blockNames[b]);
+		if (index != GL_INVALID_INDEX) {
+			glUniformBlockBinding(id, index, b);
+		}
+	}
+	//Common uniforms
+	for (int u = 0; u < UNIFORM_COUNT; u++) {
+		std::unordered_map<std::string, GLint>::const_iterator it = r.uniforms.find(uniformNames[u]);
+		r.locations[u] = it == r.uniforms.end() ? -1 : it->second;
+	}
+	reflection = &r;
+}
+
+GLint Shader::getUniform(GLuint program, Uniform u) {
+	std::unordered_map<GLuint, Reflection>::const_iterator it = reflections.find(program);
+	return it == reflections.end() ? -1 : it->second.locations[u];
+}
+
+GLint Shader::getUniformLocation(const std::string& name) const {
+	if (!reflection) {
+		return -1;
+	}
+	std::unordered_map<std::string, GLint>::const_iterator it = reflection->uniforms.find(name);
+	return it == reflection->uniforms.end() ? -1 : it->second;
+}
+
+GLint Shader::getAttribLocation(const std::string& name) const {
+	if (!reflection) {
+		return -1;
+	}
+	std::unordered_map<std::string, GLint>::const_iterator it = reflection->attributes.find(name);
+	return it == reflection->attributes.end() ? -1 : it->second;
+}
+
 std::string Shader::readFile(std::string filename) {
 	std::ifstream inStream(filename, std::ios::in);
 	if (!inStream.is_open()) {
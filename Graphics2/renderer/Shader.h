@@ -1,19 +1,66 @@
 #pragma once
 /*
 A wrapper for the GLSL shaders
+Active uniforms and attributes are looked up once when a program is linked,
+so drawing never has to ask the driver for a location by name
 */
 #include <string>
 #include <map>
+#include <unordered_map>
 #include "OpenGLSetup.h"
 class Shader {
 public:
+	//Uniforms used while drawing, their locations are found when the program is linked
+	enum Uniform {
+		MODEL,
+		VIEW,
+		PROJECTION,
+		TRANS_INV_MODEL,
+		VIEW_POS,
+		LIGHT_SPACE_MATRIX,
+		SHININESS,
+		USE_NORMAL_TEXTURE,
+		//Unpack positions and UVs stored as fractions of a range (see VertexFormat)
+		POSITION_OFFSET,
+		POSITION_SCALE,
+		UV_OFFSET,
+		UV_SCALE,
+		UNIFORM_COUNT
+	};
+	//Uniform blocks shared between programs, each is given this binding point when a program is linked
+	enum Block {
+		LIGHTS_BLOCK,
+		CLUSTERS_BLOCK,
+		SHADOWS_BLOCK,
+		BLOCK_COUNT
+	};
 	Shader();
 	Shader(std::string vert, std::string frag);
 	~Shader();
 	GLuint getProgram() { return id; };
+	// Gets the location of a common uniform, -1 if the program doesn't use it
+	GLint getUniform(Uniform u) const { return reflection ? reflection->locations[u] : -1; };
+	// Gets the location of a common uniform in any program made by this class
+	static GLint getUniform(GLuint program, Uniform u);
+	// Gets the location of any active uniform by name (including array elements and struct members)
+	// Meant for setup, rather than every draw
+	GLint getUniformLocation(const std::string& name) const;
+	// Gets the location of an active vertex attribute by name
+	GLint getAttribLocation(const std::string& name) const;
 private:
+	struct Reflection {
+		std::unordered_map<std::string, GLint> uniforms;
+		std::unordered_map<std::string, GLint> attributes;
+		GLint locations[UNIFORM_COUNT];
+	};
 	std::string readFile(std::string filename);
+	//Fills in the reflection of the program once it is linked
+	void reflect();
 	GLuint id;
+	const Reflection* reflection;
 	static std::map<std::string, GLuint> shaders;
+	static std::unordered_map<GLuint, Reflection> reflections;
+	static const char* uniformNames[UNIFORM_COUNT];
+	static const char* blockNames[BLOCK_COUNT];
 };
 
@@ -0,0 +1,271 @@
+#include "ShadowMap.h"
+#include "Camera.h"
+#include "Renderable.h"
+#include "Scene.h"
+#include "GLState.h"
+#include "glm/gtc/matrix_transform.hpp"
+
+//Defaults, the maps and their static copies are each as big as the single 2048 map a camera used to have,
+//so a light with shadows uses about twice the memory of that map
+#define SHADOW_CASCADES 4
+#define SHADOW_MAP_SIZE 1024
+#define SHADOW_DISTANCE 100.0f
+//Mostly logarithmic, so near cascades stay sharp
+#define SHADOW_SPLIT_LAMBDA 0.75f
+//Static maps cover this much more than their slice, so the view can move a while before they are redrawn
+#define SHADOW_CACHE_MARGIN 0.25f
+
+ShadowMap* ShadowMap::bound = NULL;
+
+ShadowMap::ShadowMap() {
+	count = SHADOW_CASCADES;
+	resolution = SHADOW_MAP_SIZE;
+	distance = SHADOW_DISTANCE;
+	splitLambda = SHADOW_SPLIT_LAMBDA;
+	drawCount = 0;
+	culledCount = 0;
+	staticRedraws = 0;
+	staticScene = NULL;
+	staticVersion = 0;
+	staticDirection = glm::vec3(0.0f);
+	staticBasis = glm::mat3(1.0f);
+	block.count = 0;
+	for (int i = 0; i < MAX_CASCADES; i++) {
+		block.matrices[i] = glm::mat4(1.0f);
+		splits[i] = 0.0f;
+		cascades[i].valid = false;
+	}
+	shader = Shader("shaders/shadow.vert", "shaders/shadow.frag");
+	static_assert(sizeof(ShadowBlock) == 272, "ShadowBlock must match the std140 layout of the Shadows block");
+	glGenBuffers(1, &blockBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, blockBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(ShadowBlock), &block, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glGenFramebuffers(1, &fbo);
+	glGenFramebuffers(1, &staticFbo);
+	depthMaps = 0;
+	staticMaps = 0;
+	createMaps();
+}
+
+ShadowMap::~ShadowMap() {
+	if (bound == this) {
+		bound = NULL;
+	}
+	glDeleteBuffers(1, &blockBuffer);
+	glDeleteFramebuffers(1, &fbo);
+	glDeleteFramebuffers(1, &staticFbo);
+	GLState::deleteTexture(depthMaps);
+	GLState::deleteTexture(staticMaps);
+}
+
+void ShadowMap::createMaps() {
+	GLuint* maps[2] = { &depthMaps, &staticMaps };
+	GLuint fbos[2] = { fbo, staticFbo };
+	for (int m = 0; m < 2; m++) {
+		GLState::deleteTexture(*maps[m]);
+		glGenTextures(1, maps[m]);
+		GLState::bindTexture(0, GL_TEXTURE_2D_ARRAY, *maps[m]);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, resolution, resolution, count, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+		float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+		//Layers are attached one at a time as they are drawn
+		GLState::bindFramebuffer(fbos[m]);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, *maps[m], 0, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+	}
+	GLState::bindFramebuffer(0);
+	invalidate();
+}
+
+void ShadowMap::setCascades(int count, GLsizei resolution) {
+	count = glm::clamp(count, 1, static_cast<int>(MAX_CASCADES));
+	resolution = glm::max(resolution, 1);
+	if (count == this->count && resolution == this->resolution) {
+		return;
+	}
+	this->count = count;
+	this->resolution = resolution;
+	createMaps();
+}
+
+void ShadowMap::invalidate() {
+	for (int i = 0; i < MAX_CASCADES; i++) {
+		cascades[i].valid = false;
+	}
+}
+
+void ShadowMap::invalidateChanges(Scene* scene, const glm::mat3& basis) {
+	changes.clear();
+	if (!scene->getStaticChanges(staticVersion, changes)) {
+		invalidate();
+	}
+	staticVersion = scene->getStaticVersion();
+	//Changes are in the static root's space, as is where each cascade was fitted relative to the root
+	glm::mat3 toRoot = glm::inverse(basis);
+	for (int i = 0; i < MAX_CASCADES; i++) {
+		Cascade& c = cascades[i];
+		if (!c.valid) {
+			continue;
+		}
+		glm::vec3 centre = toRoot * glm::vec3(glm::dvec3(c.centre) - c.rootPosition);
+		for (const glm::vec4& change : changes) {
+			if (glm::distance(centre, glm::vec3(change)) < c.radius + change.w) {
+				c.valid = false;
+				break;
+			}
+		}
+	}
+}
+
+//Finds a sphere around the slice of the camera's view between depths near and far
+static void getSliceSphere(Camera* cam, float near, float far, glm::vec3& centre, float& radius) {
+	//Unproject the corners of the view at both depths
+	glm::mat4 proj = cam->getProjection();
+	glm::mat4 invViewProj = glm::inverse(proj * cam->getView());
+	glm::vec3 corners[8];
+	centre = glm::vec3(0.0f);
+	for (int c = 0; c < 8; c++) {
+		glm::vec4 clip = proj * glm::vec4(0.0f, 0.0f, (c & 4) ? -far : -near, 1.0f);
+		glm::vec4 world = invViewProj * glm::vec4((c & 1) ? 1.0f : -1.0f, (c & 2) ? 1.0f : -1.0f, clip.z / clip.w, 1.0f);
+		corners[c] = glm::vec3(world) / world.w;
+		centre += corners[c] / 8.0f;
+	}
+	radius = 0.0f;
+	for (int c = 0; c < 8; c++) {
+		radius = glm::max(radius, glm::distance(centre, corners[c]));
+	}
+}
+
+void ShadowMap::fitCascade(int i, const glm::vec3& centre, float radius, const glm::vec3& direction) {
+	Cascade& c = cascades[i];
+	//A sphere keeps the same size however the view turns, so the texels don't change size either
+	c.radius = glm::ceil(radius * 16.0f) / 16.0f;
+	c.centre = centre;
+	glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f);
+	if (glm::abs(direction.y) > 0.99f) {
+		up = glm::vec3(1.0f, 0.0f, 0.0f);
+	}
+	c.lightView = glm::lookAt(centre, centre + direction, up);
+	//Casters in front of the sphere are flattened onto the near plane by depth clamping, so it doesn't need to reach them
+	c.lightProj = glm::ortho(-c.radius, c.radius, -c.radius, c.radius, -c.radius, c.radius);
+	//Snap to whole texels, so edges stay put while the view moves
+	glm::vec4 origin = c.lightProj * c.lightView * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	glm::vec2 texels = glm::vec2(origin) * (resolution / 2.0f);
+	glm::vec2 offset = (glm::round(texels) - texels) * (2.0f / resolution);
+	c.lightProj[3][0] += offset.x;
+	c.lightProj[3][1] += offset.y;
+	c.valid = true;
+}
+
+void ShadowMap::drawCasters(const std::vector<Renderable*>& casters, const glm::mat4& lightView, const glm::mat4& lightSpace,
+	float radius, bool cull) {
+	glUniformMatrix4fv(shader.getUniform(Shader::LIGHT_SPACE_MATRIX), 1, false, &lightSpace[0][0]);
+	for (Renderable* r : casters) {
+		if (cull && r->hasBounds()) {
+			const AABB& b = r->getWorldBounds();
+			glm::vec3 c = glm::vec3(lightView * glm::vec4(b.getCentre(), 1.0f));
+			float rb = glm::length(b.getExtents());
+			//Beside the cascade, or entirely past it (further from the light)
+			if (glm::abs(c.x) > radius + rb || glm::abs(c.y) > radius + rb || c.z + rb < -radius) {
+				culledCount++;
+				continue;
+			}
+		}
+		r->renderShadow(shader.getProgram());
+		drawCount++;
+	}
+}
+
+void ShadowMap::render(Camera* cam, Scene* scene, glm::vec3 direction, bool cull) {
+	direction = glm::normalize(direction);
+	//Static casters are cached relative to the static root, so they only need redrawing if it turns
+	SceneObject* root = scene->getStaticRoot();
+	glm::dvec3 rootPosition = root->getPreciseGlobalPosition();
+	glm::mat3 basis = glm::mat3(root->getGlobalMatrix());
+	if (scene != staticScene || direction != staticDirection || basis != staticBasis) {
+		invalidate();
+		staticScene = scene;
+		staticVersion = scene->getStaticVersion();
+		staticDirection = direction;
+		staticBasis = basis;
+	} else if (scene->getStaticVersion() != staticVersion) {
+		invalidateChanges(scene, basis);
+	}
+	//Static casters are drawn while hidden too, so the cache doesn't depend on what the cameras can see
+	staticCasters.clear();
+	dynamicCasters.clear();
+	for (Renderable* r : scene->getRenderables()) {
+		if (r->isStatic()) {
+			staticCasters.push_back(r);
+		} else if (r->isVisible()) {
+			dynamicCasters.push_back(r);
+		}
+	}
+	float near = cam->getNear();
+	float far = glm::max(glm::min(cam->getFar(), distance), near * 2.0f);
+	drawCount = 0;
+	culledCount = 0;
+	staticRedraws = 0;
+	GLState::useProgram(shader.getProgram());
+	GLState::setViewport(0, 0, resolution, resolution);
+	GLState::setDepthMask(true);
+	//Both faces cast shadows
+	GLState::setCulling(false);
+	glEnable(GL_DEPTH_CLAMP);
+	block.count = count;
+	float start = near;
+	for (int i = 0; i < count; i++) {
+		//Blend even and logarithmic splits
+		float t = static_cast<float>(i + 1) / count;
+		float end = glm::mix(near + (far - near) * t, near * glm::pow(far / near, t), splitLambda);
+		splits[i] = end;
+		glm::vec3 centre;
+		float radius;
+		getSliceSphere(cam, start, end, centre, radius);
+		start = end;
+		//How far the static casters have moved since they were drawn
+		Cascade& c = cascades[i];
+		glm::vec3 shift = glm::vec3(rootPosition - c.rootPosition);
+		if (!c.valid || glm::distance(centre - shift, c.centre) + radius > c.radius) {
+			fitCascade(i, centre, radius * (1.0f + SHADOW_CACHE_MARGIN), direction);
+			c.rootPosition = rootPosition;
+			shift = glm::vec3(0.0f);
+			GLState::bindFramebuffer(staticFbo);
+			glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticMaps, 0, i);
+			glClear(GL_DEPTH_BUFFER_BIT);
+			drawCasters(staticCasters, c.lightView, c.lightProj * c.lightView, c.radius, cull);
+			staticRedraws++;
+		}
+		//The whole cascade moves along with the static casters
+		glm::mat4 lightView = c.lightView * glm::translate(glm::mat4(1.0f), -shift);
+		block.matrices[i] = c.lightProj * lightView;
+		//Start from a copy of the static casters, then draw the moving ones on top
+		GLState::bindFramebuffer(fbo);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthMaps, 0, i);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, staticFbo);
+		glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticMaps, 0, i);
+		glBlitFramebuffer(0, 0, resolution, resolution, 0, 0, resolution, resolution, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		//Put the read binding back to what GLState thinks it is
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+		drawCasters(dynamicCasters, lightView, block.matrices[i], c.radius, cull);
+	}
+	glDisable(GL_DEPTH_CLAMP);
+	glBindBuffer(GL_UNIFORM_BUFFER, blockBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(ShadowBlock), &block);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void ShadowMap::bind() {
+	//The texture goes through GLState, so only the block needs checking here
+	if (bound != this) {
+		glBindBufferBase(GL_UNIFORM_BUFFER, Shader::SHADOWS_BLOCK, blockBuffer);
+		bound = this;
+	}
+	GLState::bindTexture(0, GL_TEXTURE_2D_ARRAY, depthMaps);
+}
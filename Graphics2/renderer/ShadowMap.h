@@ -0,0 +1,121 @@
+#pragma once
+/*
+Cascaded shadow map for a directional light.
+The view is split into slices by depth (a blend of even and logarithmic splits), and
+each slice gets its own layer of a depth texture array, fitted to a sphere around the
+slice so the projection doesn't change size as the view turns. Projections are snapped
+to whole texels so edges don't shimmer, and each cascade only draws the casters that
+can throw a shadow into it.
+Static casters (see Renderable::setStatic) are drawn into a separate set of maps that
+is kept between renders, fitted with room to spare and moved along with the scene's
+static root. They are only redrawn when the light turns, the view leaves the area they
+cover, or static casters join or leave the scene inside it. Hiding a static caster
+doesn't remove its shadow. Each render copies them and draws the moving casters on top,
+so the cost mostly depends on how many things move.
+Shadow maps belong to a light and are drawn once a frame, fitted to the first camera
+that needs them. Other cameras can sample them too, multiLight.frag picks the cascade
+a fragment falls in rather than going by its depth in the view.
+*/
+#include "OpenGLSetup.h"
+#include "Shader.h"
+#include "glm/glm.hpp"
+#include <cstdint>
+#include <vector>
+
+class Camera;
+class Renderable;
+class Scene;
+
+class ShadowMap {
+public:
+	//Most cascades the Shadows block has room for
+	enum { MAX_CASCADES = 4 };
+	ShadowMap();
+	~ShadowMap();
+	// Sets the number of cascades and the width (and height) of each of their maps
+	void setCascades(int count, GLsizei resolution);
+	// Gets the number of cascades
+	int getCascadeCount() const { return count; };
+	// Gets the width (and height) of each cascade's map
+	GLsizei getResolution() const { return resolution; };
+	// Sets how far from the camera shadows are drawn
+	void setDistance(float distance) { this->distance = distance; };
+	// Gets how far from the camera shadows are drawn
+	float getDistance() const { return distance; };
+	// Sets how the cascades are split, 0 is even and 1 is logarithmic
+	void setSplitLambda(float lambda) { splitLambda = lambda; };
+	// Fits the cascades to the camera's view and draws the scene's casters into them
+	// Casters outside a cascade are skipped when cull is set
+	void render(Camera* cam, Scene* scene, glm::vec3 direction, bool cull);
+	// Marks the static casters of every cascade for redrawing
+	void invalidate();
+	// Binds the maps and matrices for multiLight programs
+	void bind();
+	// Gets the light space matrix of a cascade
+	const glm::mat4& getMatrix(int cascade) const { return block.matrices[cascade]; };
+	// Gets the depth in the fitted view a cascade ends at
+	float getSplit(int cascade) const { return splits[cascade]; };
+	// Gets the number of casters drawn or culled (summed over cascades) in the last render
+	unsigned int getDrawCount() const { return drawCount; };
+	unsigned int getCulledCount() const { return culledCount; };
+	// Gets the number of cascades whose static casters were redrawn in the last render
+	unsigned int getStaticRedrawCount() const { return staticRedraws; };
+private:
+	//The Shadows block of multiLight.frag, laid out std140
+	struct ShadowBlock {
+		glm::mat4 matrices[MAX_CASCADES];
+		GLint count;
+		GLint pad[3];
+	};
+	//The static casters of a cascade, as they were last drawn
+	struct Cascade {
+		//Sphere the cascade covers, and where the static root was at the time
+		glm::vec3 centre;
+		float radius;
+		glm::dvec3 rootPosition;
+		glm::mat4 lightView;
+		glm::mat4 lightProj;
+		bool valid;
+	};
+	ShadowMap(const ShadowMap& other) = delete;
+	ShadowMap& operator=(const ShadowMap& other) = delete;
+	//(Re)creates the depth texture arrays for the current count and resolution
+	void createMaps();
+	//Marks the cascades that static casters changed inside of since staticVersion for redrawing
+	void invalidateChanges(Scene* scene, const glm::mat3& basis);
+	//Fits cascade i around a sphere in the scene
+	void fitCascade(int i, const glm::vec3& centre, float radius, const glm::vec3& direction);
+	//Draws the casters that reach a cascade, lightView maps the scene into the cascade's space
+	void drawCasters(const std::vector<Renderable*>& casters, const glm::mat4& lightView, const glm::mat4& lightSpace,
+		float radius, bool cull);
+	int count;
+	GLsizei resolution;
+	float distance;
+	float splitLambda;
+	GLuint fbo;
+	GLuint depthMaps;
+	//Static casters only, kept between renders
+	GLuint staticFbo;
+	GLuint staticMaps;
+	GLuint blockBuffer;
+	Shader shader;
+	ShadowBlock block;
+	//Depth in the fitted view each cascade ends at
+	float splits[MAX_CASCADES];
+	Cascade cascades[MAX_CASCADES];
+	//What the static maps were drawn with, they are all redrawn if any of it changes
+	Scene* staticScene;
+	glm::vec3 staticDirection;
+	glm::mat3 staticBasis;
+	//Last change to the scene's static casters the maps have been checked against
+	uint64_t staticVersion;
+	std::vector<glm::vec4> changes;
+	//The scene's casters, split for this render
+	std::vector<Renderable*> staticCasters;
+	std::vector<Renderable*> dynamicCasters;
+	unsigned int drawCount;
+	unsigned int culledCount;
+	unsigned int staticRedraws;
+	//Shadow map bound to the Shadows binding point
+	static ShadowMap* bound;
+};
@@ -14,5 +14,7 @@ public:
 	float constant;
 	float linear;
 	float quadratic;
+	// Gets the distance the light reaches before it is too dim to see
+	float getRange() { return attenuationRange(constant, linear, quadratic); };
 };
 
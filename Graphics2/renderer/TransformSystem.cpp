@@ -0,0 +1,397 @@
+#include "TransformSystem.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include "glm/gtc/matrix_transform.hpp"
+#define GLM_ENABLE_EXPERIMENTAL
+#include "glm/gtx/matrix_decompose.hpp"
+
+//Levels smaller than this per thread are swept on the calling thread
+#define TRANSFORM_THREAD_MIN 4096
+
+//Threads that sweep large levels, kept for the whole run so they aren't created and joined every frame
+class SweepWorkers {
+public:
+	typedef void (*SweepFunction)(size_t start, size_t end, uint64_t version);
+	//One thread for each core other than the caller's
+	SweepWorkers(size_t count) {
+		generation = 0;
+		busy = 0;
+		stopping = false;
+		for (size_t i = 1; i < count; i++) {
+			threads.push_back(std::thread(&SweepWorkers::work, this, i));
+		}
+	}
+	~SweepWorkers() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (std::thread& t : threads) {
+			t.join();
+		}
+	}
+	//Splits [start, end) into even slices, the caller sweeps the first and waits for the rest
+	void run(SweepFunction f, size_t start, size_t end, size_t slices, uint64_t version) {
+		slices = glm::min(slices, threads.size() + 1);
+		size_t step = (end - start + slices - 1) / slices;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job = f;
+			jobStart = start;
+			jobEnd = end;
+			jobStep = step;
+			jobSlices = slices;
+			jobVersion = version;
+			busy = slices - 1;
+			generation++;
+		}
+		wake.notify_all();
+		f(start, glm::min(start + step, end), version);
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this] { return busy == 0; });
+	}
+private:
+	void work(size_t index) {
+		uint64_t seen = 0;
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			wake.wait(lock, [this, seen] { return stopping || generation != seen; });
+			if (stopping) {
+				return;
+			}
+			seen = generation;
+			//Small levels don't need every thread
+			if (index >= jobSlices) {
+				continue;
+			}
+			SweepFunction f = job;
+			size_t start = jobStart + index * jobStep;
+			size_t end = glm::min(start + jobStep, jobEnd);
+			uint64_t version = jobVersion;
+			lock.unlock();
+			if (start < end) {
+				f(start, end, version);
+			}
+			lock.lock();
+			if (--busy == 0) {
+				done.notify_one();
+			}
+		}
+	}
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	//The level being swept, generation goes up each time there is a new one
+	SweepFunction job;
+	size_t jobStart;
+	size_t jobEnd;
+	size_t jobStep;
+	size_t jobSlices;
+	uint64_t jobVersion;
+	uint64_t generation;
+	//Workers still sweeping the current level
+	size_t busy;
+	bool stopping;
+};
+
+const TransformSystem::Handle TransformSystem::INVALID;
+std::vector<glm::dvec3> TransformSystem::positions;
+std::vector<glm::vec3> TransformSystem::scales;
+std::vector<glm::quat> TransformSystem::rotations;
+std::vector<glm::mat3> TransformSystem::localLinears;
+std::vector<glm::mat3> TransformSystem::linears;
+std::vector<glm::dvec3> TransformSystem::offsets;
+std::vector<glm::dvec3> TransformSystem::origins;
+std::vector<glm::mat4> TransformSystem::globals;
+std::vector<int> TransformSystem::parents;
+std::vector<uint64_t> TransformSystem::versions;
+std::vector<uint64_t> TransformSystem::linearVersions;
+std::vector<uint64_t> TransformSystem::parentVersions;
+std::vector<uint64_t> TransformSystem::parentLinearVersions;
+std::vector<unsigned char> TransformSystem::flags;
+std::vector<TransformSystem::Handle> TransformSystem::handles;
+std::vector<int> TransformSystem::lookup;
+std::vector<TransformSystem::Handle> TransformSystem::freeHandles;
+std::vector<size_t> TransformSystem::levels;
+bool TransformSystem::orderDirty = false;
+uint64_t TransformSystem::nextVersion = 1;
+
+TransformSystem::Handle TransformSystem::create() {
+	Handle h;
+	if (freeHandles.empty()) {
+		h = static_cast<Handle>(lookup.size());
+		lookup.push_back(-1);
+	} else {
+		h = freeHandles.back();
+		freeHandles.pop_back();
+	}
+	//Roots can go anywhere without breaking the order, but the levels need rebuilding
+	lookup[h] = static_cast<int>(handles.size());
+	positions.push_back(glm::dvec3(0.0));
+	scales.push_back(glm::vec3(1.0f));
+	rotations.push_back(glm::quat(glm::vec3(0.0f, 0.0f, 0.0f)));
+	localLinears.push_back(glm::mat3(1.0f));
+	linears.push_back(glm::mat3(1.0f));
+	offsets.push_back(glm::dvec3(0.0));
+	origins.push_back(glm::dvec3(0.0));
+	globals.push_back(glm::mat4(1.0f));
+	parents.push_back(-1);
+	versions.push_back(0);
+	linearVersions.push_back(0);
+	parentVersions.push_back(0);
+	parentLinearVersions.push_back(0);
+	flags.push_back(GLOBAL_DIRTY);
+	handles.push_back(h);
+	orderDirty = true;
+	return h;
+}
+
+void TransformSystem::destroy(Handle h) {
+	if (h >= lookup.size() || lookup[h] < 0) {
+		return;
+	}
+	//Left in place until the next sort so indices stay valid
+	flags[lookup[h]] |= DEAD;
+	lookup[h] = -1;
+	freeHandles.push_back(h);
+	orderDirty = true;
+}
+
+void TransformSystem::setParent(Handle h, Handle parent) {
+	int i = lookup[h];
+	int p = parent == INVALID ? -1 : lookup[parent];
+	if (parents[i] == p) {
+		return;
+	}
+	parents[i] = p;
+	flags[i] |= GLOBAL_DIRTY;
+	orderDirty = true;
+}
+
+void TransformSystem::setPosition(Handle h, const glm::dvec3& pos) {
+	int i = lookup[h];
+	positions[i] = pos;
+	flags[i] |= POSITION_DIRTY;
+}
+
+void TransformSystem::setScale(Handle h, const glm::vec3& scale) {
+	int i = lookup[h];
+	scales[i] = scale;
+	flags[i] |= LOCAL_DIRTY | LINEAR_DIRTY;
+}
+
+void TransformSystem::setRotation(Handle h, const glm::quat& rot) {
+	int i = lookup[h];
+	rotations[i] = rot;
+	flags[i] |= LOCAL_DIRTY | LINEAR_DIRTY;
+}
+
+void TransformSystem::setLocalMatrix(Handle h, const glm::mat4& local) {
+	int i = lookup[h];
+	localLinears[i] = glm::mat3(local);
+	glm::vec3 pos;
+	glm::vec3 skew;
+	glm::vec4 pers;
+	glm::decompose(local, scales[i], rotations[i], pos, skew, pers);
+	positions[i] = glm::dvec3(pos);
+	flags[i] = (flags[i] & ~LOCAL_DIRTY) | LINEAR_DIRTY | POSITION_DIRTY;
+}
+
+glm::dvec3 TransformSystem::getPosition(Handle h) {
+	return positions[lookup[h]];
+}
+
+glm::vec3 TransformSystem::getScale(Handle h) {
+	return scales[lookup[h]];
+}
+
+glm::quat TransformSystem::getRotation(Handle h) {
+	return rotations[lookup[h]];
+}
+
+glm::mat4 TransformSystem::getLocalMatrix(Handle h) {
+	int i = lookup[h];
+	composeLocal(i);
+	glm::mat4 local = glm::mat4(localLinears[i]);
+	local[3] = glm::vec4(glm::vec3(positions[i]), 1.0f);
+	return local;
+}
+
+glm::mat4 TransformSystem::getGlobalMatrix(Handle h) {
+	int i = lookup[h];
+	resolve(i);
+	return globals[i];
+}
+
+glm::dvec3 TransformSystem::getGlobalPosition(Handle h) {
+	int i = lookup[h];
+	resolve(i);
+	return origins[i];
+}
+
+uint64_t TransformSystem::getVersion(Handle h) {
+	int i = lookup[h];
+	resolve(i);
+	return versions[i];
+}
+
+void TransformSystem::composeLocal(int i) {
+	if (flags[i] & LOCAL_DIRTY) {
+		//Apply transformations in order: rotation, scale (translation is kept separately)
+		localLinears[i] = glm::mat3(glm::scale(glm::mat4(1.0f), scales[i])) * glm::mat3_cast(rotations[i]);
+		flags[i] &= ~LOCAL_DIRTY;
+	}
+}
+
+bool TransformSystem::updateEntry(int i, uint64_t version) {
+	composeLocal(i);
+	unsigned char f = flags[i];
+	flags[i] &= ~(POSITION_DIRTY | LINEAR_DIRTY | GLOBAL_DIRTY);
+	int p = parents[i];
+	bool parentLinearChanged = p >= 0 && parentLinearVersions[i] != linearVersions[p];
+	bool linearChanged = (f & (LINEAR_DIRTY | GLOBAL_DIRTY)) || parentLinearChanged;
+	bool offsetChanged = (f & (POSITION_DIRTY | GLOBAL_DIRTY)) || parentLinearChanged;
+	bool originChanged = offsetChanged || (p >= 0 && parentVersions[i] != versions[p]);
+	if (linearChanged) {
+		//Apply local transformation, then parent, then parent's parent, etc
+		linears[i] = p >= 0 ? linears[p] * localLinears[i] : localLinears[i];
+		linearVersions[i] = version;
+		parentLinearVersions[i] = p >= 0 ? linearVersions[p] : 0;
+	}
+	if (offsetChanged) {
+		offsets[i] = p >= 0 ? glm::dmat3(linears[p]) * positions[i] : positions[i];
+	}
+	if (originChanged) {
+		//Done in double, so a large translation cancelling out a large parent translation stays precise
+		origins[i] = p >= 0 ? origins[p] + offsets[i] : offsets[i];
+		parentVersions[i] = p >= 0 ? versions[p] : 0;
+	}
+	if (!linearChanged && !originChanged) {
+		return false;
+	}
+	globals[i] = glm::mat4(linears[i]);
+	globals[i][3] = glm::vec4(glm::vec3(origins[i]), 1.0f);
+	versions[i] = version;
+	return true;
+}
+
+void TransformSystem::resolve(int i) {
+	int p = parents[i];
+	if (p >= 0) {
+		//Bring the parent up to date first, so this costs the depth of the object rather than the size of the tree
+		resolve(p);
+	}
+	if (updateEntry(i, nextVersion)) {
+		nextVersion++;
+	}
+}
+
+void TransformSystem::sweep(size_t start, size_t end, uint64_t version) {
+	for (size_t i = start; i < end; i++) {
+		updateEntry(static_cast<int>(i), version);
+	}
+}
+
+void TransformSystem::update() {
+	if (orderDirty) {
+		reorder();
+	}
+	//Everything recalculated in this pass shares a version, it is still newer than anything before it
+	uint64_t version = nextVersion++;
+	size_t hardware = glm::max(std::thread::hardware_concurrency(), 1u);
+	for (size_t l = 0; l + 1 < levels.size(); l++) {
+		size_t start = levels[l];
+		size_t end = levels[l + 1];
+		//Everything at the same depth is independent once the level above is done
+		size_t workers = glm::min(hardware, (end - start) / TRANSFORM_THREAD_MIN);
+		if (workers < 2) {
+			sweep(start, end, version);
+			continue;
+		}
+		//Only started the first time a level is big enough to need them
+		static SweepWorkers pool(hardware);
+		pool.run(sweep, start, end, workers, version);
+	}
+}
+
+int TransformSystem::findDepth(int i, std::vector<int>& depths) {
+	if (depths[i] >= 0) {
+		return depths[i];
+	}
+	int p = parents[i];
+	//Children of destroyed transforms become roots
+	if (p >= 0 && (flags[p] & DEAD)) {
+		parents[i] = -1;
+		flags[i] |= GLOBAL_DIRTY;
+		p = -1;
+	}
+	depths[i] = p < 0 ? 0 : findDepth(p, depths) + 1;
+	return depths[i];
+}
+
+void TransformSystem::reorder() {
+	size_t count = handles.size();
+	std::vector<int> depths(count, -1);
+	int maxDepth = -1;
+	for (size_t i = 0; i < count; i++) {
+		if (!(flags[i] & DEAD)) {
+			maxDepth = glm::max(maxDepth, findDepth(static_cast<int>(i), depths));
+		}
+	}
+	//Counting sort by depth, keeping the existing order within each level
+	levels.assign(maxDepth + 2, 0);
+	for (size_t i = 0; i < count; i++) {
+		if (depths[i] >= 0) {
+			levels[depths[i] + 1]++;
+		}
+	}
+	for (size_t l = 1; l < levels.size(); l++) {
+		levels[l] += levels[l - 1];
+	}
+	std::vector<size_t> next(levels.begin(), levels.end() - 1);
+	std::vector<int> newIndex(count, -1);
+	for (size_t i = 0; i < count; i++) {
+		if (depths[i] >= 0) {
+			newIndex[i] = static_cast<int>(next[depths[i]]++);
+		}
+	}
+	//Move everything into place
+	size_t live = levels.back();
+	for (size_t i = 0; i < count; i++) {
+		if (newIndex[i] >= 0) {
+			parents[i] = parents[i] < 0 ? -1 : newIndex[parents[i]];
+			lookup[handles[i]] = newIndex[i];
+		}
+	}
+	permute(positions, newIndex, live);
+	permute(scales, newIndex, live);
+	permute(rotations, newIndex, live);
+	permute(localLinears, newIndex, live);
+	permute(linears, newIndex, live);
+	permute(offsets, newIndex, live);
+	permute(origins, newIndex, live);
+	permute(globals, newIndex, live);
+	permute(parents, newIndex, live);
+	permute(versions, newIndex, live);
+	permute(linearVersions, newIndex, live);
+	permute(parentVersions, newIndex, live);
+	permute(parentLinearVersions, newIndex, live);
+	permute(flags, newIndex, live);
+	permute(handles, newIndex, live);
+	orderDirty = false;
+}
+
+template<typename T>
+void TransformSystem::permute(std::vector<T>& v, const std::vector<int>& newIndex, size_t live) {
+	std::vector<T> moved(live);
+	for (size_t i = 0; i < newIndex.size(); i++) {
+		if (newIndex[i] >= 0) {
+			moved[newIndex[i]] = v[i];
+		}
+	}
+	v.swap(moved);
+}
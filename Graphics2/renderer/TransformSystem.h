@@ -0,0 +1,101 @@
+#pragma once
+/*
+Stores the transform of every scene object in flat arrays, kept sorted by depth
+so parents always come before their children. Scene objects only hold a handle.
+Global matrices are either brought up to date when read, or all at once by update(),
+which sweeps the arrays one depth at a time and splits large levels across threads.
+Positions and global translations are kept in double precision, so large worlds can
+be shifted around the camera and still give precise float matrices for rendering.
+Not thread safe, transforms should only be changed from the main thread.
+*/
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+
+class TransformSystem {
+public:
+	typedef unsigned int Handle;
+	static const Handle INVALID = 0xFFFFFFFF;
+	// Allocates an identity transform with no parent
+	static Handle create();
+	// Frees a transform, its handle may be reused afterwards
+	static void destroy(Handle h);
+	// Sets the parent of a transform, INVALID for none
+	static void setParent(Handle h, Handle parent);
+	// Sets the parts the local matrix is built from
+	static void setPosition(Handle h, const glm::dvec3& pos);
+	static void setScale(Handle h, const glm::vec3& scale);
+	static void setRotation(Handle h, const glm::quat& rot);
+	// Sets the local matrix directly, splitting it into position, scale and rotation
+	static void setLocalMatrix(Handle h, const glm::mat4& local);
+	static glm::dvec3 getPosition(Handle h);
+	static glm::vec3 getScale(Handle h);
+	static glm::quat getRotation(Handle h);
+	static glm::mat4 getLocalMatrix(Handle h);
+	// Gets the global matrix, recalculating it and its ancestors first if any have changed
+	static glm::mat4 getGlobalMatrix(Handle h);
+	// Gets the global translation without losing precision
+	static glm::dvec3 getGlobalPosition(Handle h);
+	// Gets a number that changes every time the global matrix is recalculated
+	static uint64_t getVersion(Handle h);
+	// Brings every global matrix up to date in one pass, call once per frame before drawing
+	static void update();
+	// Gets the number of transforms in the arrays
+	static size_t getCount() { return handles.size(); };
+private:
+	enum Flags {
+		//Position changed
+		POSITION_DIRTY = 1,
+		//Scale or rotation changed, local rotation and scale need rebuilding
+		LOCAL_DIRTY = 2,
+		//Local rotation and scale changed
+		LINEAR_DIRTY = 4,
+		//Everything needs recalculating, eg after reparenting
+		GLOBAL_DIRTY = 8,
+		DEAD = 16
+	};
+	//Per transform data, indexed by position in the sorted order
+	static std::vector<glm::dvec3> positions;
+	static std::vector<glm::vec3> scales;
+	static std::vector<glm::quat> rotations;
+	//Rotation and scale, locally and globally
+	static std::vector<glm::mat3> localLinears;
+	static std::vector<glm::mat3> linears;
+	//Position rotated and scaled into the parent's global space
+	static std::vector<glm::dvec3> offsets;
+	//Global translation
+	static std::vector<glm::dvec3> origins;
+	static std::vector<glm::mat4> globals;
+	static std::vector<int> parents;
+	//Changes when anything in the global transform changes
+	static std::vector<uint64_t> versions;
+	//Changes only when the global rotation and scale change
+	static std::vector<uint64_t> linearVersions;
+	//Versions of the parent the global transform was built from
+	static std::vector<uint64_t> parentVersions;
+	static std::vector<uint64_t> parentLinearVersions;
+	static std::vector<unsigned char> flags;
+	static std::vector<Handle> handles;
+	//Handle to index
+	static std::vector<int> lookup;
+	static std::vector<Handle> freeHandles;
+	//Index each depth starts at, plus the end
+	static std::vector<size_t> levels;
+	//Set when something was added, removed or reparented since the last sort
+	static bool orderDirty;
+	static uint64_t nextVersion;
+	static void composeLocal(int i);
+	//Recalculates a single global transform, the parent must be up to date
+	//A child whose parent only moved just adds its cached offset, without any matrix multiplies
+	static bool updateEntry(int i, uint64_t version);
+	//Recalculates a single global matrix and its ancestors
+	static void resolve(int i);
+	//Recalculates the global matrices in [start, end), all parents must already be up to date
+	static void sweep(size_t start, size_t end, uint64_t version);
+	//Sorts the arrays by depth, dropping destroyed transforms
+	static void reorder();
+	static int findDepth(int i, std::vector<int>& depths);
+	template<typename T> static void permute(std::vector<T>& v, const std::vector<int>& newIndex, size_t live);
+};
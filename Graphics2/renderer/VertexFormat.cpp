@@ -0,0 +1,30 @@
+#include "VertexFormat.h"
+
+void VertexFormat::encodeNormal(const glm::vec3& n, GLshort out[2]) {
+	//Project onto the octahedron, then fold the lower half over the upper half
+	glm::vec2 p = glm::vec2(n) / (glm::abs(n.x) + glm::abs(n.y) + glm::abs(n.z));
+	if (n.z < 0.0f) {
+		glm::vec2 sign = glm::vec2(p.x >= 0.0f ? 1.0f : -1.0f, p.y >= 0.0f ? 1.0f : -1.0f);
+		p = (1.0f - glm::abs(glm::vec2(p.y, p.x))) * sign;
+	}
+	p = glm::clamp(p, -1.0f, 1.0f);
+	out[0] = static_cast<GLshort>(glm::round(p.x * 32767.0f));
+	out[1] = static_cast<GLshort>(glm::round(p.y * 32767.0f));
+}
+
+GLuint VertexFormat::packTangent(const glm::vec3& t, float handedness) {
+	glm::vec3 c = glm::clamp(t, -1.0f, 1.0f);
+	GLuint x = static_cast<GLuint>(static_cast<int>(glm::round(c.x * 511.0f)) & 0x3FF);
+	GLuint y = static_cast<GLuint>(static_cast<int>(glm::round(c.y * 511.0f)) & 0x3FF);
+	GLuint z = static_cast<GLuint>(static_cast<int>(glm::round(c.z * 511.0f)) & 0x3FF);
+	GLuint w = static_cast<GLuint>((handedness < 0.0f ? -1 : 1) & 0x3);
+	return x | (y << 10) | (z << 20) | (w << 30);
+}
+
+GLushort VertexFormat::quantize(float v, float offset, float scale) {
+	return static_cast<GLushort>(glm::round(glm::clamp((v - offset) / scale, 0.0f, 1.0f) * 65535.0f));
+}
+
+float VertexFormat::rangeScale(float min, float max) {
+	return glm::max(max - min, 1e-6f);
+}
@@ -0,0 +1,34 @@
+#pragma once
+/*
+Packing used for vertex data on the GPU.
+Normals are octahedral encoded into two 16 bit values, tangents use 10 bits per
+component with the handedness of the bitangent in the last 2 bits, so the bitangent
+is rebuilt in the shader instead of being stored.
+Positions and UVs can be stored as 16 bit fractions of a range, the shader gets
+the range as an offset and scale (see multiLight.vert).
+*/
+#include "OpenGLSetup.h"
+#include "glm/glm.hpp"
+
+//A vertex of a mesh with its own buffers (20 bytes)
+struct GpuVertex {
+	//Fraction of the mesh's bounds, w is padding
+	GLushort position[4];
+	//Fraction of the mesh's UV range
+	GLushort uv[2];
+	GLshort normal[2];
+	//GL_INT_2_10_10_10_REV
+	GLuint tangent;
+};
+
+class VertexFormat {
+public:
+	// Encodes a unit vector as two signed normalized 16 bit values
+	static void encodeNormal(const glm::vec3& n, GLshort out[2]);
+	// Packs a unit tangent and the sign of its bitangent into 2_10_10_10
+	static GLuint packTangent(const glm::vec3& t, float handedness);
+	// Converts a value into a 16 bit fraction of the range starting at offset
+	static GLushort quantize(float v, float offset, float scale);
+	// Gets the scale used to quantize a range, never 0 so flat ranges still work
+	static float rangeScale(float min, float max);
+};
@@ -1,6 +1,4 @@
 #version 330 core
-#define NUM_POINT 8
-#define NUM_SPOT 8
 
 in mat3 TBN;
 in vec2 texCoords;
@@ -9,37 +7,39 @@ in vec3 normVec;
 
 out vec4 color;
 
+//Light structures are laid out std140
 struct DirectionalLight {
 	vec3 direction;
 	vec3 colour;
 };
-struct PointLight {
-	vec3 position;
-	vec3 colour;
-	//Attenuation
-	float constant;
-	float linear;
-	float quadratic;
+//Light properties, shared by every mesh in a scene and uploaded once per frame
+layout(std140) uniform Lights {
+	DirectionalLight dirLight;
+	vec3 ambient;
+	int numDirLights;
 };
-struct SpotLight {
-	vec3 position;
-	vec3 direction;
-	vec3 colour;
-	float cutOff;
-	float outerCutOff;
-	//Attenuation
-	float constant;
-	float linear;
-	float quadratic;
+//Point and spot lights binned into clusters of the camera's view, see LightClusters
+layout(std140) uniform Clusters {
+	mat4 clusterView;
+	//Clusters in x, y and z
+	vec4 clusterGrid;
+	//Viewport size, then the scale and bias turning log(depth) into a slice
+	vec4 clusterParams;
+};
+//Directional light shadows, a layer of the shadow map for each slice of the view they were fitted to
+layout(std140) uniform Shadows {
+	mat4 lightSpaceMatrices[4];
+	int numCascades;
 };
-//Light properties
-uniform DirectionalLight dirLight;
-uniform PointLight[NUM_POINT] pointLights;
-uniform SpotLight[NUM_SPOT] spotLights;
-uniform int numDirLights;
-uniform int numPointLights;
-uniform int numSpotLights;
-uniform vec3 ambient;
+//Four texels per light:
+//position, constant
+//colour, linear
+//direction, quadratic
+//cutOff, outerCutOff (point lights have a cone that covers everything)
+uniform samplerBuffer lights;
+//First light index and number of lights of each cluster
+uniform usamplerBuffer clusters;
+uniform usamplerBuffer lightIndices;
 uniform float shininess;
 
 //Textures
@@ -49,16 +49,14 @@ uniform sampler2D normalMap;
 uniform sampler2D emissionMap;
 
 //Shadows
-uniform sampler2D shadow;
-uniform mat4 lightSpaceMatrix;
+uniform sampler2DArray shadow;
 
 uniform vec3 viewPos;
 
 uniform bool useNormalTexture;
 
 void calcDirectional();
-void calcPointLight();
-void calcSpotLight();
+void calcLight(int light);
 
 vec3 col3;
 vec3 norm;
@@ -66,33 +64,41 @@ vec3 diffuseColour;
 vec3 specularColour;
 vec3 viewDir;
 
-int i;
-
 float calcShadow(vec3 lightDir){
-	//Perform calculation here because when multiple lights have shadows cant use vert
-	vec4 lPos = lightSpaceMatrix * vec4(fragmentPos, 1.0);
-	//Perform perspective transform
-	vec3 lPos3 = (lPos.xyz / lPos.w);
+	//Use the first (sharpest) cascade the fragment is inside of, leaving room for the filter
+	//The shadows may have been fitted to another camera, so this can't go by depth in this view
+	vec2 texelSize = 1.0 / vec2(textureSize(shadow, 0).xy);
+	int cascade = 0;
+	vec3 lPos3;
+	for(; cascade < numCascades; cascade++){
+		//Perform calculation here because when multiple lights have shadows cant use vert
+		vec4 lPos = lightSpaceMatrices[cascade] * vec4(fragmentPos, 1.0);
+		//Perform perspective transform
+		lPos3 = lPos.xyz / lPos.w;
+		if(all(lessThan(abs(lPos3.xy), 1.0 - 4.0 * texelSize)) && lPos3.z <= 1.0){
+			break;
+		}
+	}
+	if(cascade == numCascades){
+		return 0.0;
+	}
 	//Change range to [0,1]
 	lPos3 = lPos3 * 0.5 + 0.5;
-	//float closestDepth = texture(shadow, lPos3.xy).r;
-	if(lPos3.z > 1.0){
-        return 0.0;
-	}
-	//Compare depth (with small bias) to shadowmap
-	float bias = max(0.05 * (1.0 - dot(normVec, lightDir)), 0.005);
+	//Every cascade is as deep as it is wide, so a bias in texels is the same size in each
+	//Steeper surfaces change depth faster across the filter, so need more
+	float cosTheta = clamp(dot(normVec, lightDir), 0.05, 1.0);
+	float slope = min(sqrt(1.0 - cosTheta * cosTheta) / cosTheta, 4.0);
+	float bias = (1.0 + 1.5 * slope) * texelSize.x;
 	
 	float s = 0.0;
-	vec2 texelSize = 1.0 / textureSize(shadow, 0);
 	for(int x = -1; x <= 1; ++x) {
 		for(int y = -1; y <= 1; ++y) {
-			float pcfDepth = texture(shadow, lPos3.xy + vec2(x, y) * texelSize).r; 
+			float pcfDepth = texture(shadow, vec3(lPos3.xy + vec2(x, y) * texelSize, cascade)).r; 
 			s += lPos3.z - bias > pcfDepth ? 1.0 : 0.0;        
 		}    
 	}
 	s /= 9.0;
 	return s;
-	//return lPos3.z - bias > closestDepth ? 1.0 : 0.0;
 }
 
 void main(){
@@ -118,13 +124,14 @@ void main(){
 	if(numDirLights!=0){
 		calcDirectional();
 	}
-	//Add point lights
-	for(i=0;i<numPointLights;i++){
-		calcPointLight();
-	}
-	//Add spotlights
-	for(i=0;i<numSpotLights;i++){
-		calcSpotLight();
+	//Find the cluster of the fragment
+	float depth = -(clusterView * vec4(fragmentPos, 1.0)).z;
+	ivec3 c = ivec3(gl_FragCoord.xy / clusterParams.xy * clusterGrid.xy, log(max(depth, 1e-4)) * clusterParams.z + clusterParams.w);
+	c = clamp(c, ivec3(0), ivec3(clusterGrid.xyz) - 1);
+	uvec2 range = texelFetch(clusters, (c.z * int(clusterGrid.y) + c.y) * int(clusterGrid.x) + c.x).xy;
+	//Add the point and spot lights that reach it
+	for(uint i = 0u; i < range.y; i++){
+		calcLight(int(texelFetch(lightIndices, int(range.x + i)).r));
 	}
 	color = vec4(col3, 1.0);
 }
@@ -139,29 +146,21 @@ void calcDirectional(){
 	col3 += (diff * diffuseColour + spec * specularColour) * dirLight.colour * (1.0 - shadow);
 }
 
-void calcPointLight(){
-	vec3 lightDir = normalize(pointLights[i].position - fragmentPos);
-	//Blinn-Phong
-	vec3 halfDir = normalize(lightDir + viewDir);
-	float dist = length(pointLights[i].position - fragmentPos);
-	float attenuation = 1.0 / (pointLights[i].constant + pointLights[i].linear * dist + 
-    		    pointLights[i].quadratic * (dist * dist));  
-	float diff = max(dot(norm, lightDir), 0.0);
-	float spec = max(0.0, pow(max(dot(norm, halfDir), 0.0), shininess));
-	col3 += (diff * diffuseColour + spec * specularColour) * pointLights[i].colour * attenuation;
-}
-
-void calcSpotLight(){
-	vec3 lightDir = normalize(spotLights[i].position - fragmentPos);
+void calcLight(int light){
+	vec4 positionConstant = texelFetch(lights, light * 4);
+	vec4 colourLinear = texelFetch(lights, light * 4 + 1);
+	vec4 directionQuadratic = texelFetch(lights, light * 4 + 2);
+	vec2 cone = texelFetch(lights, light * 4 + 3).xy;
+	vec3 lightDir = normalize(positionConstant.xyz - fragmentPos);
 	//Blinn-Phong
 	vec3 halfDir = normalize(lightDir + viewDir);
-	float dist = length(spotLights[i].position - fragmentPos);
-	float attenuation = 1.0 / (spotLights[i].constant + spotLights[i].linear * dist + 
-    		    spotLights[i].quadratic * (dist * dist));
-	float theta = dot(lightDir, normalize(-spotLights[i].direction));
-	float epsilon = spotLights[i].cutOff - spotLights[i].outerCutOff;
-	float intensity = clamp((theta - spotLights[i].outerCutOff) / epsilon, 0.0, 1.0);
+	float dist = length(positionConstant.xyz - fragmentPos);
+	float attenuation = 1.0 / (positionConstant.w + colourLinear.w * dist + 
+    		    directionQuadratic.w * (dist * dist));
+	float theta = dot(lightDir, normalize(-directionQuadratic.xyz));
+	float epsilon = cone.x - cone.y;
+	float intensity = clamp((theta - cone.y) / epsilon, 0.0, 1.0);
 	float diff = max(dot(norm, lightDir), 0.0);
 	float spec = max(0.0, pow(max(dot(norm, halfDir), 0.0), shininess));
-	col3 += (diff * diffuseColour + spec * specularColour) * spotLights[i].colour * attenuation * intensity;
+	col3 += (diff * diffuseColour + spec * specularColour) * colourLinear.rgb * attenuation * intensity;
 }
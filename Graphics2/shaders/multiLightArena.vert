@@ -0,0 +1,47 @@
+#version 330 core
+//Chunks drawn together from a MeshArena, see MeshArena.h
+//Positions are fractions of their chunk's bounds
+layout(location = 0) in vec3 vertexPosition;
+layout(location = 1) in vec2 vertexUV;
+//Octahedral encoded
+layout(location = 2) in vec2 vertexNormal;
+layout(location = 4) in uint vertexChunk;
+
+//Transform of the first chunk drawn, only its rotation and scale are used
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+uniform mat3 transInvModel;
+uniform vec2 uvOffset;
+uniform vec2 uvScale;
+//Two texels per chunk, where its bounds start in world space and their size
+uniform samplerBuffer chunks;
+
+out mat3 TBN;
+out vec3 normVec;
+out vec2 texCoords;
+out vec3 fragmentPos;
+
+vec3 decodeNormal(vec2 e) {
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0) {
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	}
+	return normalize(n);
+}
+
+void main(){
+	int chunk = int(vertexChunk) * 2;
+	vec3 start = texelFetch(chunks, chunk).xyz;
+	vec3 size = texelFetch(chunks, chunk + 1).xyz;
+	//Calculate position of fragment in world space
+	fragmentPos = start + mat3(model) * (vertexPosition * size);
+	//Pass tex coords
+	texCoords = uvOffset + vertexUV * uvScale;
+	//Standard transformation
+	gl_Position = projection * view * vec4(fragmentPos, 1.0);
+	//Chunks have no tangents
+	vec3 N = normalize(vec3(transInvModel * decodeNormal(vertexNormal)));
+	TBN = mat3(vec3(0.0), vec3(0.0), N);
+	normVec = N;
+}
@@ -0,0 +1,50 @@
+#version 330 core
+//Positions and UVs are fractions of the ranges given by the offset and scale uniforms
+layout(location = 0) in vec3 vertexPosition;
+layout(location = 1) in vec2 vertexUV;
+//Octahedral encoded
+layout(location = 2) in vec2 vertexNormal;
+//The handedness of the bitangent is in w
+layout(location = 3) in vec4 vertexTangent;
+//Transform of each copy, takes up locations 5 to 8
+layout(location = 5) in mat4 instanceModel;
+
+//Transform of the mesh within the model
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+uniform vec2 uvOffset;
+uniform vec2 uvScale;
+
+out mat3 TBN;
+out vec3 normVec;
+out vec2 texCoords;
+out vec3 fragmentPos;
+
+vec3 decodeNormal(vec2 e) {
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0) {
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	}
+	return normalize(n);
+}
+
+void main(){
+	mat4 world = instanceModel * model;
+	mat3 transInvModel = transpose(inverse(mat3(world)));
+	vec3 position = positionOffset + vertexPosition * positionScale;
+	//Pass tex coords
+	texCoords = uvOffset + vertexUV * uvScale;
+	//Standard transformation
+	gl_Position = projection * view * world * vec4(position, 1.0);
+	//Translate coordinates to be in tangent space
+	vec3 T = normalize(vec3(transInvModel * vertexTangent.xyz));
+	vec3 N = normalize(vec3(transInvModel * decodeNormal(vertexNormal)));
+	vec3 B = cross(N, T) * (vertexTangent.w < 0.0 ? -1.0 : 1.0);
+	TBN = mat3(T,B,N);
+	normVec = N;
+	//Calculate position of fragment in world space
+	fragmentPos = vec3(world * vec4(position, 1.0));
+}
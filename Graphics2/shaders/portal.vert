@@ -3,6 +3,9 @@ layout (location = 0) in vec3 vertexPos;
 
 uniform mat4 lightSpaceMatrix;
 uniform mat4 model;
+//Unpacks the mesh's position
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
 
 out vec2 screenSize;
 
@@ -10,6 +13,6 @@ float screenWidth = 1280;
 float screenHeight = 720;
 
 void main(){
-	gl_Position = lightSpaceMatrix * model * vec4(vertexPos, 1.0);
+	gl_Position = lightSpaceMatrix * model * vec4(positionOffset + vertexPos * positionScale, 1.0);
 	screenSize = vec2(screenWidth, screenHeight);
 }
\ No newline at end of file
@@ -3,7 +3,10 @@ layout (location = 0) in vec3 vertexPos;
 
 uniform mat4 lightSpaceMatrix;
 uniform mat4 model;
+//Unpacks the mesh's position
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
 
 void main() {
-    gl_Position = lightSpaceMatrix * model * vec4(vertexPos, 1.0);
+    gl_Position = lightSpaceMatrix * model * vec4(positionOffset + vertexPos * positionScale, 1.0);
 } 
\ No newline at end of file
@@ -0,0 +1,101 @@
+#include "ChunkResidency.h"
+#include "Planet.h"
+
+ChunkResidency::ChunkResidency() : ChunkResidency(SIZE_MAX, SIZE_MAX) {
+}
+
+ChunkResidency::ChunkResidency(size_t cpuBudget, size_t gpuBudget) {
+	this->cpuBudget = cpuBudget;
+	this->gpuBudget = gpuBudget;
+	cpuUsage = 0;
+	gpuUsage = 0;
+}
+
+ChunkResidency::~ChunkResidency() {
+}
+
+void ChunkResidency::setBudgets(size_t cpuBudget, size_t gpuBudget) {
+	this->cpuBudget = cpuBudget;
+	this->gpuBudget = gpuBudget;
+}
+
+void ChunkResidency::touch(Planet* planet, int lod, int face, int x, int y, size_t cpuBytes, size_t gpuBytes, bool inUse) {
+	uint64_t key = makeKey(lod, face, x, y);
+	std::unordered_map<uint64_t, std::list<Entry>::iterator>& chunks = lookup[planet];
+	std::list<Entry>& list = inUse ? this->inUse : entries;
+	auto it = chunks.find(key);
+	if (it != chunks.end()) {
+		//Already resident, move to the front of its list and refresh its size
+		Entry& e = *it->second;
+		cpuUsage -= e.cpuBytes;
+		gpuUsage -= e.gpuBytes;
+		e.cpuBytes = cpuBytes;
+		e.gpuBytes = gpuBytes;
+		list.splice(list.begin(), e.inUse ? this->inUse : entries, it->second);
+		e.inUse = inUse;
+	} else {
+		list.push_front({ planet, key, cpuBytes, gpuBytes, inUse });
+		chunks[key] = list.begin();
+	}
+	cpuUsage += cpuBytes;
+	gpuUsage += gpuBytes;
+}
+
+void ChunkResidency::remove(Planet* planet, int lod, int face, int x, int y) {
+	auto p = lookup.find(planet);
+	if (p == lookup.end()) {
+		return;
+	}
+	auto it = p->second.find(makeKey(lod, face, x, y));
+	if (it == p->second.end()) {
+		return;
+	}
+	cpuUsage -= it->second->cpuBytes;
+	gpuUsage -= it->second->gpuBytes;
+	(it->second->inUse ? inUse : entries).erase(it->second);
+	p->second.erase(it);
+}
+
+void ChunkResidency::removePlanet(Planet* planet) {
+	auto p = lookup.find(planet);
+	if (p == lookup.end()) {
+		return;
+	}
+	for (auto& chunk : p->second) {
+		cpuUsage -= chunk.second->cpuBytes;
+		gpuUsage -= chunk.second->gpuBytes;
+		(chunk.second->inUse ? inUse : entries).erase(chunk.second);
+	}
+	lookup.erase(p);
+}
+
+void ChunkResidency::trim() {
+	//Only chunks not in use are in the list, so evict from the least recently used end
+	while (overBudget() && !entries.empty()) {
+		Entry& e = entries.back();
+		Planet* planet = e.planet;
+		int lod, face, x, y;
+		splitKey(e.key, lod, face, x, y);
+		cpuUsage -= e.cpuBytes;
+		gpuUsage -= e.gpuBytes;
+		lookup[planet].erase(e.key);
+		entries.pop_back();
+		planet->evictChunk(lod, face, x, y);
+	}
+}
+
+bool ChunkResidency::overBudget() const {
+	return cpuUsage > cpuBudget || gpuUsage > gpuBudget;
+}
+
+uint64_t ChunkResidency::makeKey(int lod, int face, int x, int y) {
+	return (static_cast<uint64_t>(lod & 0xFF) << 56) | (static_cast<uint64_t>(face & 0xFF) << 48) |
+		(static_cast<uint64_t>(x & 0xFFFFFF) << 24) | static_cast<uint64_t>(y & 0xFFFFFF);
+}
+
+void ChunkResidency::splitKey(uint64_t key, int &lod, int &face, int &x, int &y) {
+	lod = static_cast<int>((key >> 56) & 0xFF);
+	face = static_cast<int>((key >> 48) & 0xFF);
+	x = static_cast<int>((key >> 24) & 0xFFFFFF);
+	y = static_cast<int>(key & 0xFFFFFF);
+}
@@ -0,0 +1,59 @@
+#pragma once
+/*
+Keeps track of which terrain chunks are resident in memory.
+Chunks that are not in use are kept in least recently used order, and once the
+CPU or GPU budget is exceeded the oldest of them are handed back to their planet
+to be freed. Chunks in use are kept apart, so trimming never has to walk past
+them. A single residency manager can be shared between planets.
+GPU memory is what the chunks' meshes take in their arena, the arena hands
+pages back once everything in them is freed.
+*/
+#include <list>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+class Planet;
+
+class ChunkResidency {
+public:
+	ChunkResidency();
+	ChunkResidency(size_t cpuBudget, size_t gpuBudget);
+	~ChunkResidency();
+	// Sets the maximum number of bytes of CPU and GPU memory chunks may use
+	void setBudgets(size_t cpuBudget, size_t gpuBudget);
+	// Marks a chunk as used, adding it if it isn't resident yet
+	// Chunks in use (shown) are never evicted
+	void touch(Planet* planet, int lod, int face, int x, int y, size_t cpuBytes, size_t gpuBytes, bool inUse);
+	// Stops tracking a chunk (does not free it)
+	void remove(Planet* planet, int lod, int face, int x, int y);
+	// Stops tracking every chunk belonging to a planet
+	void removePlanet(Planet* planet);
+	// Evicts least recently used chunks until back under budget
+	void trim();
+	// Gets the memory currently used by resident chunks
+	size_t getCpuUsage() const { return cpuUsage; };
+	size_t getGpuUsage() const { return gpuUsage; };
+	// Gets the number of resident chunks
+	size_t getResidentCount() const { return entries.size() + inUse.size(); };
+private:
+	struct Entry {
+		Planet* planet;
+		uint64_t key;
+		size_t cpuBytes;
+		size_t gpuBytes;
+		bool inUse;
+	};
+	static uint64_t makeKey(int lod, int face, int x, int y);
+	static void splitKey(uint64_t key, int &lod, int &face, int &x, int &y);
+	bool overBudget() const;
+	//Chunks that can be evicted, front is most recently used
+	std::list<Entry> entries;
+	//Chunks in use, in no particular order
+	std::list<Entry> inUse;
+	std::unordered_map<Planet*, std::unordered_map<uint64_t, std::list<Entry>::iterator>> lookup;
+	size_t cpuBudget;
+	size_t gpuBudget;
+	size_t cpuUsage;
+	size_t gpuUsage;
+};
@@ -1,5 +1,8 @@
 #include "Planet.h"
 #include <random>
+#include <cfloat>
+#include <chrono>
+#include <algorithm>
 #include "../renderer/glm/gtc/matrix_transform.hpp"
 
 #include <iostream>
@@ -15,16 +18,45 @@
 
 #define TEX_REPEAT 64.0f
 
-Planet::Planet() {
+//Fraction of each LOD altitude a viewer must pass before the LOD changes back
+#define LOD_HYSTERESIS 0.1f
+//Fraction of a grid the viewer must move past the edge of the centre grid before it changes
+#define GRID_HYSTERESIS 0.25f
+//Default limits on how many LOD changes are applied per frame
+#define LOD_MAX_TRANSITIONS 8
+#define LOD_MAX_MICROS 2000
+//Default largest error (in pixels) allowed before a grid switches to more detail
+#define LOD_PIXEL_ERROR 4.0f
+
+Planet::Planet() : arena(TEX_REPEAT) {
 	lastPos = glm::vec3(0.0f, 0.0f, 0.0f);
+	residency = &localResidency;
+	maxTransitions = LOD_MAX_TRANSITIONS;
+	maxMicros = LOD_MAX_MICROS;
+	viewCamera = NULL;
+	pixelError = LOD_PIXEL_ERROR;
+	errorScale = 0.0f;
+	for (int i = 0; i < NUM_LOD; i++) {
+		LOD_Enter[i] = LOD_Distances[i];
+		LOD_Exit[i] = LOD_Distances[i];
+	}
 }
 
 
 Planet::~Planet() {
+	//The builds use the meshes, so must be finished before they go
+	for (OctreeBuild* b : octreeBuilds) {
+		finishOctrees(b);
+	}
+	octreeBuilds.clear();
+	residency->removePlanet(this);
+	//Every mesh comes from the pool, so they can all go at once
+	meshPool.clear();
 }
 
 
 void Planet::generateTerrain(int octDepth) {
+	this->octDepth = octDepth;
 	//Allocate memory for heightmap
 	std::cout << "Allocating memory for heightmap" << std::endl;
 	for (unsigned int f = 0; f < 6; f++) {
@@ -46,58 +78,28 @@ void Planet::generateTerrain(int octDepth) {
 	createTransformations();
 
 	/*
-	For each level of detail calculate necessary size of grid (per face)
-	Create mesh for each grid on each face at each LOD
+	Each face is split into grids, with a mesh for each grid at each LOD
 	LOD0 = Every vertex (lots of grids needed to keep under 65k indices)
 	LOD1 = Every other vertex
 	LOD2 = Every 4th vertex
 	Etc
+	Meshes are only built when a grid is first shown at that LOD (see buildChunk), so
+	no more than the residency budget is ever built. Only the culling bounds need the
+	whole planet, and they come straight from the heightmap
 	*/
 	numGrids = numNodes / MAX_VERTS;
-	for (int l = 0; l < NUM_LOD; l++) {
-		std::cout << "Converting heightmap to meshes (LOD" << l << ")" << std::endl;
-		//For each face
-		for (int face = 0; face < 6; face++) {
-			//For each grid cell
-			for (int gridX = 0; gridX < numGrids; gridX++) {
-				int minX = MAX_VERTS * gridX;
-				int maxX = gridX == numGrids - 1 ? numNodes - 1 : minX + MAX_VERTS;
-				for (int gridY = 0; gridY < numGrids; gridY++) {
-					//Calculate bounds of the grid
-					int minY = MAX_VERTS * gridY;
-					int maxY = gridY == numGrids - 1 ? numNodes - 1 : minY + MAX_VERTS;
-					generateGrid(l, face, minX, minY, maxX, maxY);
-					makeMeshes(l, face, gridX, gridY);
-				}
-			}
-		}
-	}
-	//*
-	//Because for some reason this can take upwards of 10 mins to run in 1 thread, I'll just max out the CPU
-	std::cout << "Generating collision data" << std::endl;
-	for (int face = 0; face < 6; face++) {
-		//For each grid cell
-		for (int gridX = 0; gridX < numGrids; gridX++) {
-			for (int gridY = 0; gridY < numGrids; gridY++) {
-				PlanetMeshes* m = &LODS[0][face][gridX][gridY];
-				if (m->grass) {
-					std::thread* t = new std::thread([m, octDepth] { m->grass->createOctree(octDepth); });
-				}
-				if (m->sea) {
-					std::thread* t = new std::thread([m, octDepth] { m->sea->createOctree(octDepth); });
-				}
-				if (m->rock) {
-					std::thread* t = new std::thread([m, octDepth] { m->rock->createOctree(octDepth); });
-				}
-			}
-		}
-	}
-	for (std::thread* t : threads) {
-		t->join();
-		delete t;
-	}
-	threads.clear();
-	//*/
+	PlanetMeshes unbuilt;
+	unbuilt.sea = NULL;
+	unbuilt.grass = NULL;
+	unbuilt.rock = NULL;
+	unbuilt.resident = false;
+	unbuilt.cpuBytes = 0;
+	unbuilt.gpuBytes = 0;
+	LODS.assign(NUM_LOD, std::vector<std::vector<std::vector<PlanetMeshes>>>(6,
+		std::vector<std::vector<PlanetMeshes>>(numGrids, std::vector<PlanetMeshes>(numGrids, unbuilt))));
+	lastLOD.assign(6, std::vector<std::vector<int>>(numGrids, std::vector<int>(numGrids, -1)));
+	std::cout << "Calculating culling bounds" << std::endl;
+	computeCullBounds();
 }
 
 void Planet::updateVisible(SceneObject* highLod, SceneObject* lowLod, glm::vec3 pos, std::unordered_set<Mesh*> &highPoly) {
@@ -153,77 +155,206 @@ void Planet::updateVisible(SceneObject* highLod, SceneObject* lowLod, glm::vec3
 		yTrans = 0.0f;
 	}
 	//Get grid position from pos
-	int gridX = glm::clamp(static_cast<int>(floor((numGrids - 1) * (xTrans + 1.0f) / 2.0f)), 0, numGrids - 1);
-	int gridY = glm::clamp(static_cast<int>(floor((numGrids - 1) * (yTrans + 1.0f) / 2.0f)), 0, numGrids - 1);
+	float posX = (numGrids - 1) * (xTrans + 1.0f) / 2.0f;
+	float posY = (numGrids - 1) * (yTrans + 1.0f) / 2.0f;
+	int gridX = glm::clamp(static_cast<int>(floor(posX)), 0, numGrids - 1);
+	int gridY = glm::clamp(static_cast<int>(floor(posY)), 0, numGrids - 1);
+	//Keep the old centre grid until pos is clearly outside of it
+	if (face != centreFace ||
+		posX < centreX - GRID_HYSTERESIS || posX > centreX + 1.0f + GRID_HYSTERESIS ||
+		posY < centreY - GRID_HYSTERESIS || posY > centreY + 1.0f + GRID_HYSTERESIS) {
+		centreFace = face;
+		centreX = gridX;
+		centreY = gridY;
+	}
 	float height = glm::dot(pos, pos);
-	int startLod = NUM_LOD - 1;
-	while (startLod > 1 && height < LOD_Distances[startLod]) { startLod--; }
+	//Thresholds differ depending on direction, so hovering near one doesn't flip back and forth
+	while (currentLod > 1 && height < LOD_Enter[currentLod]) { currentLod--; }
+	while (currentLod < NUM_LOD - 1 && height > LOD_Exit[currentLod + 1]) { currentLod++; }
+	if (height < LOD_Enter[0]) {
+		nearSurface = true;
+	} else if (height > LOD_Exit[0]) {
+		nearSurface = false;
+	}
+	//Converts geometric error at a distance of 1 to pixels on screen
+	if (viewCamera) {
+		errorScale = viewCamera->getHeight() / (2.0f * static_cast<float>(tan(viewCamera->getFOV() / 2.0f)));
+	} else {
+		errorScale = 0.0f;
+	}
+	//Walk each face's quadtree, whole quadrants are rejected without looking at their grids
+	Horizon horizon(pos, glm::vec3(0.0f), occluderRadius);
+	for (int f = 0; f < 6; f++) {
+		cullNode(f, faceRoots[f], pos, horizon, currentLod);
+	}
+	//Make closest grids high res if near enough
+	if (nearSurface) {
+		for (int gx = -1; gx < 2; gx++) {
+			for (int gy = -1; gy < 2; gy++) {
+				int grX = centreX + gx;
+				int grY = centreY + gy;
+				int grF = centreFace;
+				moveInBoundsGrid(grF, grX, grY);
+				targetLOD[grF][grX][grY] = 0;
+			}
+		}
+	}
+	//Queue every grid that needs to change, most important first
+	pending.clear();
 	for (int f = 0; f < 6; f++) {
 		for (int x = 0; x < numGrids; x++) {
 			for (int y = 0; y < numGrids; y++) {
-				int lod = startLod;
-				//Get centre node
-				int dX = MAX_VERTS;
-				int dY = MAX_VERTS;
-				if (x == numGrids - 1) {
-					dX = numNodes - x * MAX_VERTS;
-				}
-				if (y == numGrids - 1) {
-					dY = numNodes - y * MAX_VERTS;
+				if (targetLOD[f][x][y] != lastLOD[f][x][y]) {
+					Transition t = { f, x, y, transitionPriority(f, x, y, pos) };
+					pending.push_back(t);
 				}
-				int cX = x * MAX_VERTS + dX / 2;
-				int cY = y * MAX_VERTS + dY / 2;
-				glm::vec3 centre = getVertex(cX, cY, f, heightSea);
-				//Cull back facing grids
-				if (glm::dot(centre, pos) < 0.0f) {
-					lod = -1;
-				}
-				//Change in LOD found
-				changeLod(f, x, y, lod, highLod, lowLod, highPoly);
 			}
 		}
 	}
-	//Make closest grids high res if near enough
-	if (height < LOD_Distances[0]) {
-		for (int gx = -1; gx < 2; gx++) {
-			for (int gy = -1; gy < 2; gy++) {
-				int grX = gridX + gx;
-				int grY = gridY + gy;
-				int grF = face;
-				moveInBoundsGrid(grF, grX, grY);
-				changeLod(grF, grX, grY, 0, highLod, lowLod, highPoly);
+	std::sort(pending.begin(), pending.end(), [](const Transition& a, const Transition& b) { return a.priority > b.priority; });
+	updateTransitions(highLod, lowLod, highPoly);
+}
+
+void Planet::updateTransitions(SceneObject* highLod, SceneObject* lowLod, std::unordered_set<Mesh*> &highPoly, bool flush) {
+	//Finished octrees are picked up every frame, whether or not any LODs are changing
+	collectOctrees();
+	if (pending.empty()) {
+		return;
+	}
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	int applied = 0;
+	size_t i = 0;
+	for (; i < pending.size(); i++) {
+		Transition& t = pending[i];
+		int target = targetLOD[t.face][t.x][t.y];
+		if (lastLOD[t.face][t.x][t.y] == target) {
+			continue;
+		}
+		//Hiding is only a flag write so isn't budgeted, and at least one change is always made
+		if (!flush && target >= 0 && applied > 0) {
+			long long micros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+			if (applied >= maxTransitions || micros >= maxMicros) {
+				break;
+			}
+		}
+		changeLod(t.face, t.x, t.y, target, highLod, lowLod, highPoly);
+		if (target >= 0) {
+			applied++;
+		}
+	}
+	pending.erase(pending.begin(), pending.begin() + i);
+	//Free anything over budget now that the visible set has changed
+	residency->trim();
+}
+
+void Planet::setTransitionBudget(int maxTransitions, int maxMicros) {
+	this->maxTransitions = glm::max(maxTransitions, 1);
+	this->maxMicros = maxMicros;
+}
+
+float Planet::transitionPriority(int f, int x, int y, const glm::vec3& pos) {
+	int target = targetLOD[f][x][y];
+	int shown = lastLOD[f][x][y];
+	//Hiding is cheap, and collisions need the full detail grids, so both go first
+	if (target < 0) {
+		return FLT_MAX;
+	}
+	if (target == 0) {
+		return FLT_MAX / 2.0f;
+	}
+	//Then grids that aren't shown at all, as they leave holes
+	if (shown < 0) {
+		return FLT_MAX / 4.0f;
+	}
+	const CullBounds& b = gridBounds[f][x][y];
+	float dist = glm::max(glm::length(b.centre - pos) - b.radius, 1.0f);
+	//Otherwise by how wrong the grid currently looks on screen
+	if (errorScale > 0.0f) {
+		return gridErrors[f][x][y][shown] * errorScale / dist;
+	}
+	//Without a camera use how large the grid appears instead
+	return b.radius / dist;
+}
+
+int Planet::selectLod(int f, int x, int y, const glm::vec3& pos) {
+	const CullBounds& b = gridBounds[f][x][y];
+	float dist = glm::max(glm::length(b.centre - pos) - b.radius, 1.0f);
+	float pixels = errorScale / dist;
+	int shown = lastLOD[f][x][y];
+	//Coarsest LOD whose error is small enough on screen
+	for (int l = NUM_LOD - 1; l > 1; l--) {
+		//Stricter when dropping detail, so a grid near the limit doesn't flip back and forth
+		float tolerance = l > shown ? pixelError * (1.0f - LOD_HYSTERESIS) : pixelError;
+		if (gridErrors[f][x][y][l] * pixels <= tolerance) {
+			return l;
+		}
+	}
+	//Full detail is only used near the viewer (for collisions)
+	return 1;
+}
+
+void Planet::setViewCamera(Camera* cam) {
+	viewCamera = cam;
+}
+
+void Planet::setPixelError(float pixels) {
+	pixelError = glm::max(pixels, 0.0f);
+}
+
+void Planet::cullNode(int face, int node, const glm::vec3& pos, const Horizon& horizon, int lod) {
+	const CullNode& n = cullNodes[node];
+	//Only grids that can't be seen from anywhere around pos are hidden, the view frustum is left to the cameras
+	//so terrain just off screen still casts shadows and turning doesn't swap chunks in and out
+	if (isBackFacing(n.bounds, pos) || horizon.isHidden(n.bounds.centre, n.bounds.radius)) {
+		for (int x = n.minGX; x < n.maxGX; x++) {
+			for (int y = n.minGY; y < n.maxGY; y++) {
+				targetLOD[face][x][y] = -1;
 			}
 		}
+		return;
+	}
+	if (n.children[0] < 0) {
+		targetLOD[face][n.minGX][n.minGY] = viewCamera ? selectLod(face, n.minGX, n.minGY, pos) : lod;
+		return;
+	}
+	for (int i = 0; i < 4; i++) {
+		if (n.children[i] >= 0) {
+			cullNode(face, n.children[i], pos, horizon, lod);
+		}
 	}
 }
 
+bool inline Planet::isBackFacing(const CullBounds& b, const glm::vec3& pos) {
+	//Every triangle faces away if the view direction is within the cone, for all of the sphere
+	glm::vec3 toCentre = b.centre - pos;
+	return glm::dot(toCentre, b.coneAxis) >= b.coneCutoff * glm::length(toCentre) + b.radius;
+}
+
 void Planet::hide() {
 	std::unordered_set<Mesh*> hp;
+	pending.clear();
 	for (int f = 0; f < 6; f++) {
 		for (int x = 0; x < numGrids; x++) {
 			for (int y = 0; y < numGrids; y++) {
+				targetLOD[f][x][y] = -1;
 				changeLod(f, x, y, -1, NULL, NULL, hp);
+				//Take it out of the scene too, so it stops casting shadows
+				detachChunk(f, x, y);
 			}
 		}
 	}
+	residency->trim();
 }
 
 void inline Planet::changeLod(int f, int x, int y, int lod, SceneObject* highLod, SceneObject* lowLod, std::unordered_set<Mesh*> &highPoly) {
-	if (lastLOD[f][x][y] != lod) {
-		PlanetMeshes m;
-		SceneObject* s = NULL;
+	int last = lastLOD[f][x][y];
+	if (last != lod) {
+		//Hiding a grid only changes whether it is drawn, it stays in the scene (and keeps casting shadows)
+		//until another LOD replaces it, so static shadows aren't redrawn as grids go in and out of view
 		//Hide old meshes
 		if (lastLOD[f][x][y] >= 0) {
-			m = LODS[lastLOD[f][x][y]][f][x][y];
-			if (m.grass) {
-				m.grass->setParent(s);
-			}
-			if (m.sea) {
-				m.sea->setParent(s);
-			}
-			if (m.rock) {
-				m.rock->setParent(s);
-			}
+			PlanetMeshes& m = LODS[lastLOD[f][x][y]][f][x][y];
+			setVisible(m, false);
 			if (lastLOD[f][x][y] == 0) {
 				if (m.grass) {
 					highPoly.erase(m.grass);
@@ -238,21 +369,17 @@ void inline Planet::changeLod(int f, int x, int y, int lod, SceneObject* highLod
 		}
 		//Show new meshes
 		if (lod >= 0) {
-			m = LODS[lod][f][x][y];
-			if (lod == 0) {
-				s = highLod;
-			} else if (lod > 0) {
-				s = lowLod;
-			}
-			if (m.grass) {
-				m.grass->setParent(s);
+			if (!LODS[lod][f][x][y].resident) {
+				buildChunk(lod, f, x, y);
 			}
-			if (m.sea) {
-				m.sea->setParent(s);
-			}
-			if (m.rock) {
-				m.rock->setParent(s);
+			PlanetMeshes& m = LODS[lod][f][x][y];
+			if (attachedLOD[f][x][y] != lod) {
+				detachChunk(f, x, y);
+				attachedLOD[f][x][y] = lod;
 			}
+			//Only attached the first time they're shown (or if the scene they belong in changed)
+			changeParent(m, lod == 0 ? highLod : lowLod);
+			setVisible(m, true);
 			if (lod == 0) {
 				if (m.grass) {
 					highPoly.insert(m.grass);
@@ -267,7 +394,380 @@ void inline Planet::changeLod(int f, int x, int y, int lod, SceneObject* highLod
 		}
 		//Update last LOD
 		lastLOD[f][x][y] = lod;
+		//Touched after the update, so the residency knows which of the two is in use
+		if (last >= 0) {
+			touchChunk(last, f, x, y);
+		}
+		if (lod >= 0) {
+			touchChunk(lod, f, x, y);
+		}
+	}
+}
+
+void Planet::setResidency(ChunkResidency* r) {
+	if (!r) {
+		r = &localResidency;
+	}
+	if (r == residency) {
+		return;
+	}
+	residency->removePlanet(this);
+	residency = r;
+	//Re-register any chunks that are already built
+	for (int l = 0; l < static_cast<int>(LODS.size()); l++) {
+		for (int f = 0; f < static_cast<int>(LODS[l].size()); f++) {
+			for (int x = 0; x < static_cast<int>(LODS[l][f].size()); x++) {
+				for (int y = 0; y < static_cast<int>(LODS[l][f][x].size()); y++) {
+					touchChunk(l, f, x, y);
+				}
+			}
+		}
+	}
+}
+
+bool Planet::isChunkInUse(int lod, int face, int x, int y) {
+	return lastLOD[face][x][y] == lod;
+}
+
+void Planet::evictChunk(int lod, int face, int x, int y) {
+	PlanetMeshes& m = LODS[lod][face][x][y];
+	if (!m.resident) {
+		return;
+	}
+	if (attachedLOD[face][x][y] == lod) {
+		attachedLOD[face][x][y] = -1;
+	}
+	if (lod == 0) {
+		for (size_t i = 0; i < octreeBuilds.size(); i++) {
+			OctreeBuild* b = octreeBuilds[i];
+			if (b->face == face && b->x == x && b->y == y) {
+				finishOctrees(b);
+				octreeBuilds.erase(octreeBuilds.begin() + i);
+				break;
+			}
+		}
+	}
+	//Meshes remove themselves from their parent and scene when destroyed
+	meshPool.destroy(m.sea);
+	meshPool.destroy(m.grass);
+	meshPool.destroy(m.rock);
+	m.sea = NULL;
+	m.grass = NULL;
+	m.rock = NULL;
+	m.resident = false;
+	m.cpuBytes = 0;
+	m.gpuBytes = 0;
+}
+
+void Planet::getGridBounds(int gridX, int gridY, int &minX, int &minY, int &maxX, int &maxY) {
+	minX = MAX_VERTS * gridX;
+	maxX = gridX == numGrids - 1 ? numNodes - 1 : minX + MAX_VERTS;
+	minY = MAX_VERTS * gridY;
+	maxY = gridY == numGrids - 1 ? numNodes - 1 : minY + MAX_VERTS;
+}
+
+void Planet::buildChunk(int l, int face, int gridX, int gridY) {
+	int minX, minY, maxX, maxY;
+	getGridBounds(gridX, gridY, minX, minY, maxX, maxY);
+	generateGrid(l, face, minX, minY, maxX, maxY);
+	makeMeshes(l, face, gridX, gridY);
+	//Only the highest detail is used for collisions, built off the main thread so it doesn't hold up LOD changes
+	if (l == 0) {
+		startOctrees(face, gridX, gridY);
+	}
+}
+
+void Planet::startOctrees(int face, int gridX, int gridY) {
+	PlanetMeshes& m = LODS[0][face][gridX][gridY];
+	if (!m.grass && !m.sea && !m.rock) {
+		return;
+	}
+	OctreeBuild* b = new OctreeBuild();
+	b->face = face;
+	b->x = gridX;
+	b->y = gridY;
+	b->meshes[0] = m.grass;
+	b->meshes[1] = m.sea;
+	b->meshes[2] = m.rock;
+	b->done = false;
+	int depth = octDepth;
+	//Only reads the meshes' vertices and indices, which don't change once built
+	b->thread = std::thread([b, depth] {
+		for (int i = 0; i < 3; i++) {
+			b->trees[i] = b->meshes[i] ? b->meshes[i]->makeOctree(depth) : NULL;
+		}
+		b->done = true;
+	});
+	octreeBuilds.push_back(b);
+}
+
+void Planet::collectOctrees() {
+	size_t kept = 0;
+	for (size_t i = 0; i < octreeBuilds.size(); i++) {
+		OctreeBuild* b = octreeBuilds[i];
+		if (!b->done) {
+			octreeBuilds[kept++] = b;
+			continue;
+		}
+		int face = b->face;
+		int x = b->x;
+		int y = b->y;
+		finishOctrees(b);
+		//Measure the chunk again now it has collision data
+		LODS[0][face][x][y].cpuBytes = 0;
+		touchChunk(0, face, x, y);
+	}
+	octreeBuilds.resize(kept);
+}
+
+void Planet::finishOctrees(OctreeBuild* b) {
+	b->thread.join();
+	for (int i = 0; i < 3; i++) {
+		if (b->meshes[i]) {
+			b->meshes[i]->setOctree(b->trees[i]);
+		}
+	}
+	delete b;
+}
+
+void Planet::touchChunk(int l, int face, int gridX, int gridY) {
+	PlanetMeshes& m = LODS[l][face][gridX][gridY];
+	if (!m.resident) {
+		return;
+	}
+	//Sizes only change when collision data is added, so only measure once
+	if (m.cpuBytes == 0) {
+		m.gpuBytes = 0;
+		Mesh* meshes[] = { m.sea, m.grass, m.rock };
+		for (Mesh* mesh : meshes) {
+			if (mesh) {
+				m.cpuBytes += mesh->getCpuMemory();
+				m.gpuBytes += mesh->getGpuMemory();
+			}
+		}
+	}
+	residency->touch(this, l, face, gridX, gridY, m.cpuBytes, m.gpuBytes, isChunkInUse(l, face, gridX, gridY));
+}
+
+void Planet::computeCullBounds() {
+	//Anything beneath the lowest node is always covered by the surface
+	float lowest = minHeight;
+	for (int f = 0; f < 6; f++) {
+		for (int x = 0; x < numNodes; x++) {
+			for (int y = 0; y < numNodes; y++) {
+				lowest = glm::min(lowest, heightmap[f][x][y]);
+			}
+		}
+	}
+	occluderRadius = planetScale * (1.0f + lowest);
+	gridBounds.clear();
+	gridErrors.clear();
+	cullNodes.clear();
+	//Nothing is shown until the first update
+	targetLOD = lastLOD;
+	attachedLOD = lastLOD;
+	for (int f = 0; f < 6; f++) {
+		std::vector<std::vector<CullBounds>> face;
+		for (int x = 0; x < numGrids; x++) {
+			std::vector<CullBounds> column;
+			for (int y = 0; y < numGrids; y++) {
+				column.push_back(makeGridBounds(f, x, y));
+			}
+			face.push_back(column);
+		}
+		gridBounds.push_back(face);
+		std::vector<std::vector<std::vector<float>>> faceErrors;
+		for (int x = 0; x < numGrids; x++) {
+			std::vector<std::vector<float>> column;
+			for (int y = 0; y < numGrids; y++) {
+				std::vector<float> errors;
+				for (int l = 0; l < NUM_LOD; l++) {
+					errors.push_back(getGridError(l, f, x, y));
+				}
+				column.push_back(errors);
+			}
+			faceErrors.push_back(column);
+		}
+		gridErrors.push_back(faceErrors);
+		faceRoots[f] = buildCullNode(f, 0, 0, numGrids, numGrids);
+	}
+}
+
+Planet::CullBounds Planet::makeGridBounds(int face, int gridX, int gridY) {
+	int minX, minY, maxX, maxY;
+	getGridBounds(gridX, gridY, minX, minY, maxX, maxY);
+	int w = maxX - minX + 1;
+	int h = maxY - minY + 1;
+	//Every LOD uses a subset of the full resolution nodes, so bounding those covers them all
+	std::vector<glm::vec3> land;
+	std::vector<glm::vec3> sea;
+	glm::vec3 low = glm::vec3(FLT_MAX);
+	glm::vec3 high = glm::vec3(-FLT_MAX);
+	for (int y = minY; y <= maxY; y++) {
+		for (int x = minX; x <= maxX; x++) {
+			glm::vec3 l = getVertex(x, y, face);
+			glm::vec3 s = getVertex(x, y, face, heightSea);
+			land.push_back(l);
+			sea.push_back(s);
+			low = glm::min(low, glm::min(l, s));
+			high = glm::max(high, glm::max(l, s));
+		}
+	}
+	CullBounds b;
+	b.centre = (low + high) * 0.5f;
+	b.radius = 0.0f;
+	for (int i = 0; i < static_cast<int>(land.size()); i++) {
+		b.radius = glm::max(b.radius, glm::max(glm::length(land[i] - b.centre), glm::length(sea[i] - b.centre)));
+	}
+	//Take normals of both diagonal splits of every cell, so any LOD's triangulation is covered
+	std::vector<glm::vec3> normals;
+	glm::vec3 sum = glm::vec3(0.0f);
+	std::vector<glm::vec3>* surfaces[] = { &land, &sea };
+	for (std::vector<glm::vec3>* v : surfaces) {
+		for (int y = 0; y < h - 1; y++) {
+			for (int x = 0; x < w - 1; x++) {
+				glm::vec3 c[4] = { (*v)[x + y * w], (*v)[x + 1 + y * w], (*v)[x + 1 + (y + 1) * w], (*v)[x + (y + 1) * w] };
+				int tris[4][3] = { { 0, 1, 2 }, { 0, 2, 3 }, { 0, 1, 3 }, { 1, 2, 3 } };
+				for (int t = 0; t < 4; t++) {
+					glm::vec3 n = glm::cross(c[tris[t][1]] - c[tris[t][0]], c[tris[t][2]] - c[tris[t][0]]);
+					float len = glm::length(n);
+					if (len <= 0.0f) {
+						continue;
+					}
+					n /= len;
+					//Heights are radial so every triangle faces outwards, this just fixes winding
+					if (glm::dot(n, c[tris[t][0]]) < 0.0f) {
+						n = -n;
+					}
+					normals.push_back(n);
+					sum += n;
+				}
+			}
+		}
+	}
+	b.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+	b.coneCutoff = 2.0f;
+	if (glm::length(sum) > 0.0f) {
+		b.coneAxis = glm::normalize(sum);
+		float minDot = 1.0f;
+		for (glm::vec3& n : normals) {
+			minDot = glm::min(minDot, glm::dot(n, b.coneAxis));
+		}
+		if (minDot > 0.0f) {
+			b.coneCutoff = static_cast<float>(sqrt(1.0f - minDot * minDot));
+		}
+	}
+	return b;
+}
+
+float Planet::getGridError(int l, int face, int gridX, int gridY) {
+	if (l == 0) {
+		return 0.0f;
+	}
+	int minX, minY, maxX, maxY;
+	getGridBounds(gridX, gridY, minX, minY, maxX, maxY);
+	int step = 1 << l;
+	float error = 0.0f;
+	//Compare every full resolution node to the surface of the LOD's cell it falls in
+	for (int x = minX; x <= maxX; x++) {
+		int x0 = glm::min(minX + ((x - minX) / step) * step, maxX);
+		int x1 = glm::min(x0 + step, maxX);
+		float tx = x1 > x0 ? static_cast<float>(x - x0) / (x1 - x0) : 0.0f;
+		for (int y = minY; y <= maxY; y++) {
+			int y0 = glm::min(minY + ((y - minY) / step) * step, maxY);
+			int y1 = glm::min(y0 + step, maxY);
+			float ty = y1 > y0 ? static_cast<float>(y - y0) / (y1 - y0) : 0.0f;
+			//Sea covers anything below it
+			float h00 = glm::max(getNode(face, x0, y0), heightSea);
+			float h10 = glm::max(getNode(face, x1, y0), heightSea);
+			float h01 = glm::max(getNode(face, x0, y1), heightSea);
+			float h11 = glm::max(getNode(face, x1, y1), heightSea);
+			float h = glm::max(getNode(face, x, y), heightSea);
+			float interp = glm::mix(glm::mix(h00, h10, tx), glm::mix(h01, h11, tx), ty);
+			error = glm::max(error, abs(h - interp) * planetScale);
+		}
+	}
+	//The coarser cells also cut through the curve of the planet
+	int x1 = glm::min(minX + step, maxX);
+	int y1 = glm::min(minY + step, maxY);
+	glm::vec3 a = getVertex(minX, minY, face, heightSea);
+	glm::vec3 b = getVertex(x1, y1, face, heightSea);
+	float radius = glm::length(a);
+	float halfChord = glm::length(b - a) / 2.0f;
+	error += radius - static_cast<float>(sqrt(glm::max(radius * radius - halfChord * halfChord, 0.0f)));
+	return error;
+}
+
+int Planet::buildCullNode(int face, int minGX, int minGY, int maxGX, int maxGY) {
+	CullNode n;
+	n.minGX = minGX;
+	n.minGY = minGY;
+	n.maxGX = maxGX;
+	n.maxGY = maxGY;
+	for (int i = 0; i < 4; i++) {
+		n.children[i] = -1;
+	}
+	if (maxGX - minGX == 1 && maxGY - minGY == 1) {
+		n.bounds = gridBounds[face][minGX][minGY];
+		cullNodes.push_back(n);
+		return static_cast<int>(cullNodes.size()) - 1;
 	}
+	//Split into quadrants (or halves along a thin edge)
+	int midX = maxGX - minGX > 1 ? (minGX + maxGX) / 2 : maxGX;
+	int midY = maxGY - minGY > 1 ? (minGY + maxGY) / 2 : maxGY;
+	int xs[3] = { minGX, midX, maxGX };
+	int ys[3] = { minGY, midY, maxGY };
+	CullBounds childBounds[4];
+	int count = 0;
+	for (int i = 0; i < 2; i++) {
+		for (int j = 0; j < 2; j++) {
+			if (xs[i] == xs[i + 1] || ys[j] == ys[j + 1]) {
+				continue;
+			}
+			//Index may be invalidated by children being added, so fetch bounds afterwards
+			int child = buildCullNode(face, xs[i], ys[j], xs[i + 1], ys[j + 1]);
+			n.children[count] = child;
+			childBounds[count] = cullNodes[child].bounds;
+			count++;
+		}
+	}
+	n.bounds = mergeBounds(childBounds, count);
+	cullNodes.push_back(n);
+	return static_cast<int>(cullNodes.size()) - 1;
+}
+
+Planet::CullBounds Planet::mergeBounds(const CullBounds* bounds, int count) {
+	CullBounds b;
+	glm::vec3 low = glm::vec3(FLT_MAX);
+	glm::vec3 high = glm::vec3(-FLT_MAX);
+	glm::vec3 sum = glm::vec3(0.0f);
+	bool cullable = true;
+	for (int i = 0; i < count; i++) {
+		low = glm::min(low, bounds[i].centre - glm::vec3(bounds[i].radius));
+		high = glm::max(high, bounds[i].centre + glm::vec3(bounds[i].radius));
+		sum += bounds[i].coneAxis;
+		cullable = cullable && bounds[i].coneCutoff <= 1.0f;
+	}
+	b.centre = (low + high) * 0.5f;
+	b.radius = 0.0f;
+	for (int i = 0; i < count; i++) {
+		b.radius = glm::max(b.radius, glm::length(bounds[i].centre - b.centre) + bounds[i].radius);
+	}
+	b.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+	b.coneCutoff = 2.0f;
+	if (cullable && glm::length(sum) > 0.0f) {
+		b.coneAxis = glm::normalize(sum);
+		//Widest angle any child cone reaches from the new axis
+		float spread = 0.0f;
+		for (int i = 0; i < count; i++) {
+			float d = glm::clamp(glm::dot(b.coneAxis, bounds[i].coneAxis), -1.0f, 1.0f);
+			spread = glm::max(spread, static_cast<float>(acos(d) + asin(bounds[i].coneCutoff)));
+		}
+		if (spread < glm::half_pi<float>()) {
+			b.coneCutoff = static_cast<float>(sin(spread));
+		}
+	}
+	return b;
 }
 
 void Planet::setLODS(float lods[NUM_LOD]) {
@@ -276,6 +776,11 @@ void Planet::setLODS(float lods[NUM_LOD]) {
 	for (int i = 0; i < NUM_LOD; i++) {
 		float l = lods[i] + planetScale;
 		LOD_Distances[i] = l * l;
+		//Must be well inside to switch to a LOD, and well outside to switch back
+		float enter = lods[i] * (1.0f - LOD_HYSTERESIS) + planetScale;
+		float exit = lods[i] * (1.0f + LOD_HYSTERESIS) + planetScale;
+		LOD_Enter[i] = enter * enter;
+		LOD_Exit[i] = exit * exit;
 	}
 
 }
@@ -359,18 +864,19 @@ inline void Planet::generateGrid(int l, int f, int minX, int minY, int maxX, int
 	int step = 1 << l;
 	int nodesX = (maxX - minX) / step;
 	int nodesY = (maxY - minY) / step;
-	float scale = l == 0 ? 1.0f : lowLodScale;
 	nodesInGrid = nodesX;
+	//Vertices are kept relative to the centre of the grid, which is where its meshes are placed
+	gridOrigin = getPreciseVertex((minX + maxX) / 2, (minY + maxY) / 2, f, heightSea);
 	//Generate arrays for vertex data
 	for (int y = 0; y <= nodesY; y++) {
 		int lY = y * step + minY;
 		for (int x = 0; x <= nodesX; x++) {
 			int lX = x * step + minX;
-			vert_sea.push_back(getVertex(lX, lY, f, heightSea) * scale);
-			glm::vec3 v = getVertex(lX, lY, f);
-			vert_land.push_back(v * scale);
+			vert_sea.push_back(glm::vec3(getPreciseVertex(lX, lY, f, heightSea) - gridOrigin));
+			glm::dvec3 v = getPreciseVertex(lX, lY, f, getNode(f, lX, lY));
+			vert_land.push_back(glm::vec3(v - gridOrigin));
 			uv.push_back(TEX_REPEAT * glm::vec2(static_cast<float>(lX) / (numNodes), static_cast<float>(lY) / (numNodes)));
-			norm.push_back(glm::normalize(v));
+			norm.push_back(glm::vec3(glm::normalize(v)));
 		}
 	}
 	for (int y = 0; y <= nodesY; y++) {
@@ -448,37 +954,15 @@ inline void Planet::generateGrid(int l, int f, int minX, int minY, int maxX, int
 
 inline void Planet::makeMeshes(int l, int face, int gridX, int gridY) {
 	PlanetMeshes meshes;
-	if (LODS.size() <= static_cast<unsigned int>(l)) {
-		std::vector<std::vector<std::vector<PlanetMeshes>>> n;
-		LODS.push_back(n);
-	}
-	if (LODS[l].size() <= static_cast<unsigned int>(face)) {
-		std::vector<std::vector<PlanetMeshes>> n;
-		LODS[l].push_back(n);
-	}
-	if (LODS[l][face].size() <= static_cast<unsigned int>(gridX)) {
-		std::vector<PlanetMeshes> n;
-		LODS[l][face].push_back(n);
-	}
-	if (LODS[l][face][gridX].size() <= gridY) {
-		LODS[l][face][gridX].push_back(meshes);
-	}
-	if (lastLOD.size() <= static_cast<unsigned int>(face)) {
-		std::vector<std::vector<int>> last;
-		lastLOD.push_back(last);
-	}
-	if (lastLOD[face].size() <= static_cast<unsigned int>(gridX)) {
-		std::vector<int> last;
-		lastLOD[face].push_back(last);
-	}
-	if (lastLOD[face][gridX].size() <= static_cast<unsigned int>(gridY)) {
-		lastLOD[face][gridX].push_back(-1);
-	}
+	meshes.resident = true;
+	meshes.cpuBytes = 0;
+	meshes.gpuBytes = 0;
 	//Set mesh
 	if (ind_sea.size() > 0) {
-		Mesh* m = new Mesh();
-		m->setMesh(ind_sea, vert_sea, uv, norm, std::vector<glm::vec3>(), std::vector<glm::vec3>());
+		Mesh* m = meshPool.get(meshPool.create());
+		m->setMesh(&arena, ind_sea, vert_sea, uv, norm);
 		m->useNormalTexture = false;
+		m->setVisible(false);
 		meshes.sea = m;
 		meshes.sea->setDiffuse(seaTex);
 		meshes.sea->setShininess(32.0f);
@@ -488,9 +972,12 @@ inline void Planet::makeMeshes(int l, int face, int gridX, int gridY) {
 	}
 	//Set mesh
 	if (ind_land.size() > 0) {
-		Mesh* m = new Mesh();
-		m->setMesh(ind_land, vert_land, uv, norm, std::vector<glm::vec3>(), std::vector<glm::vec3>());
+		Mesh* m = meshPool.get(meshPool.create());
+		m->setMesh(&arena, ind_land, vert_land, uv, norm);
 		m->useNormalTexture = false;
+		m->setVisible(false);
+		//Land is solid, so can hide anything behind hills
+		m->occluder = true;
 		meshes.grass = m;
 		meshes.grass->setDiffuse(landTex);
 		meshes.grass->setShininess(32.0f);
@@ -500,9 +987,12 @@ inline void Planet::makeMeshes(int l, int face, int gridX, int gridY) {
 	}
 	//Set mesh
 	if (ind_rock.size() > 0) {
-		Mesh* m = new Mesh();
-		m->setMesh(ind_rock, vert_land, uv, norm, std::vector<glm::vec3>(), std::vector<glm::vec3>());
+		Mesh* m = meshPool.get(meshPool.create());
+		m->setMesh(&arena, ind_rock, vert_land, uv, norm);
 		m->useNormalTexture = false;
+		m->setVisible(false);
+		//Land is solid, so can hide anything behind hills
+		m->occluder = true;
 		meshes.rock = m;
 		meshes.rock->setDiffuse(rockTex);
 		meshes.rock->setShininess(32.0f);
@@ -510,6 +1000,17 @@ inline void Planet::makeMeshes(int l, int face, int gridX, int gridY) {
 	} else {
 		meshes.rock = NULL;
 	}
+	//Every LOD has the same chunk-relative geometry, the low LODs' scale is in the transform
+	double scale = l == 0 ? 1.0 : lowLodScale;
+	Mesh* all[] = { meshes.sea, meshes.grass, meshes.rock };
+	for (Mesh* m : all) {
+		if (m) {
+			m->setPosition(gridOrigin * scale);
+			m->setScale(glm::vec3(static_cast<float>(scale)));
+			//Terrain never moves, so its shadows can be cached
+			m->setStatic(true);
+		}
+	}
 	ind_sea.clear();
 	ind_land.clear();
 	ind_rock.clear();
@@ -883,6 +1384,13 @@ glm::vec3 Planet::getVertex(int x, int y, int face, float height) {
 	return p;
 }
 
+glm::dvec3 Planet::getPreciseVertex(int x, int y, int face, float height) {
+	//Same as getVertex, but kept in double precision so it can be made relative to a grid
+	glm::dvec3 p = glm::dvec3(glm::vec3(faceTrans[face] * glm::vec4(x, 0.0f, y, 1.0f)));
+	p = glm::normalize(p);
+	return p * (static_cast<double>(height) + 1.0) * static_cast<double>(planetScale);
+}
+
 void Planet::addTriangle(int l, int f, int(&xs)[6], int(&ys)[6]) {
 	bool addSea = false;
 	bool addLand = false;
@@ -927,13 +1435,30 @@ void Planet::addTriangle(int l, int f, int(&xs)[6], int(&ys)[6]) {
 }
 
 inline void Planet::changeParent(PlanetMeshes& meshes, SceneObject* parent) {
+	Mesh* all[] = { meshes.sea, meshes.grass, meshes.rock };
+	for (Mesh* m : all) {
+		if (m && m->getParent() != parent) {
+			m->setParent(parent);
+		}
+	}
+}
+
+void Planet::detachChunk(int f, int x, int y) {
+	int lod = attachedLOD[f][x][y];
+	if (lod >= 0) {
+		changeParent(LODS[lod][f][x][y], NULL);
+		attachedLOD[f][x][y] = -1;
+	}
+}
+
+inline void Planet::setVisible(PlanetMeshes& meshes, bool visible) {
 	if (meshes.sea) {
-		meshes.sea->setParent(parent);
+		meshes.sea->setVisible(visible);
 	}
 	if (meshes.grass) {
-		meshes.grass->setParent(parent);
+		meshes.grass->setVisible(visible);
 	}
 	if (meshes.rock) {
-		meshes.rock->setParent(parent);
+		meshes.rock->setVisible(visible);
 	}
 }
@@ -2,8 +2,13 @@
 #include <vector>
 #include "..\renderer\Mesh.h"
 #include "..\renderer\Scene.h"
+#include "..\renderer\Horizon.h"
+#include "..\renderer\Pool.h"
+#include "..\renderer\MeshArena.h"
+#include "ChunkResidency.h"
 #include <unordered_set>
 #include <thread>
+#include <atomic>
 
 //Graphical settings (LOD)
 #define NUM_LOD 3
@@ -16,10 +21,32 @@ public:
 	void generateTerrain(int octDepth);
 	//Updates the list of meshes that can be seen
 	void updateVisible(SceneObject* highLod, SceneObject* lowLod, glm::vec3 pos, std::unordered_set<Mesh*> &highPoly);
+	//Applies waiting LOD changes, up to the per frame budget unless flush is set
+	void updateTransitions(SceneObject* highLod, SceneObject* lowLod, std::unordered_set<Mesh*> &highPoly, bool flush = false);
+	//Sets how many LOD changes, or microseconds spent on them, are allowed per frame
+	void setTransitionBudget(int maxTransitions, int maxMicros);
+	//Sets the camera used to measure terrain error on screen (NULL uses altitude bands instead)
+	void setViewCamera(Camera* cam);
+	//Sets the largest error, in pixels, allowed before more detail is used
+	void setPixelError(float pixels);
+	//Gets the number of LOD changes waiting to be applied
+	int getPendingTransitions() const { return static_cast<int>(pending.size()); }
 	//Hides the planet
 	void hide();
 
 	void setLODS(float lods[NUM_LOD]);
+	//Gets the radius of a sphere that is always beneath the surface, anything behind it can't be seen
+	float getOccluderRadius() const { return occluderRadius; }
+	//Sets the residency manager chunks are tracked by (may be shared between planets)
+	void setResidency(ChunkResidency* r);
+	//Whether a chunk is currently shown, and so can't be evicted
+	bool isChunkInUse(int lod, int face, int x, int y);
+	//Frees the meshes and collision data of a chunk, it will be rebuilt when next needed
+	void evictChunk(int lod, int face, int x, int y);
+	//Gets the pool every chunk mesh is allocated from, for measuring memory use
+	const Pool<Mesh>& getMeshPool() const { return meshPool; }
+	//Gets the arena every chunk's geometry is stored in
+	const MeshArena& getArena() const { return arena; }
 
 	float planetScale = 1.0f;
 	float lowLodScale = 1.0f;
@@ -46,9 +73,41 @@ private:
 		Mesh* sea;
 		Mesh* grass;
 		Mesh* rock;
+		//Whether the meshes have been built (all three can be NULL for an empty chunk)
+		bool resident;
+		size_t cpuBytes;
+		//Bytes the meshes take in the arena
+		size_t gpuBytes;
+	};
+	//Conservative bounds of a grid (or group of grids), covering every LOD
+	struct CullBounds {
+		glm::vec3 centre;
+		float radius;
+		//Cone containing every triangle normal, cutoff is the sine of its spread
+		//A cutoff above 1 means the cone is too wide to cull with
+		glm::vec3 coneAxis;
+		float coneCutoff;
+	};
+	//A grid waiting to change LOD
+	struct Transition {
+		int face;
+		int x;
+		int y;
+		float priority;
+	};
+	//Node of a face's culling quadtree, leaves are single grids
+	struct CullNode {
+		CullBounds bounds;
+		//Grid range covered (max is exclusive)
+		int minGX, minGY, maxGX, maxGY;
+		//Indices into cullNodes, -1 if unused
+		int children[4];
 	};
 	//Maximum distance at which that LOD is used
 	float LOD_Distances[NUM_LOD] = { 0.1f, 0.5f, 1.0f };
+	//Distances at which a LOD is switched to and away from (hysteresis)
+	float LOD_Enter[NUM_LOD];
+	float LOD_Exit[NUM_LOD];
 	//The number of grids in each direction of each face
 	int numGrids;
 
@@ -57,18 +116,56 @@ private:
 	void inline createTransformations();
 	void inline generateGrid(int l, int face, int minX, int minY, int maxX, int maxY);
 	void inline makeMeshes(int l, int face, int gridX, int gridY);
+	void getGridBounds(int gridX, int gridY, int &minX, int &minY, int &maxX, int &maxY);
+	//Rebuilds an evicted chunk from the heightmap
+	void buildChunk(int l, int face, int gridX, int gridY);
+	//Records the memory used by a chunk and marks it as recently used
+	void touchChunk(int l, int face, int gridX, int gridY);
 	void inline setNode(float value, unsigned int face, unsigned int x, unsigned int y);
 	void moveInBounds(int &face, int &x, int &y);
 	void moveInBoundsGrid(int &face, int &x, int &y);
 	float getNode(int face, int x, int y);
 	glm::vec3 inline getVertex(int x, int y, int face);
 	glm::vec3 inline getVertex(int x, int y, int face, float height);
+	glm::dvec3 inline getPreciseVertex(int x, int y, int face, float height);
 	void inline addTriangle(int l, int f, int (&xs)[6], int (&ys)[6]);
 	void inline changeLod(int f, int x, int y, int lod, SceneObject* highLod, SceneObject* lowLod, std::unordered_set<Mesh*> &highPoly);
 
+	//Culling helper methods
+	void computeCullBounds();
+	CullBounds makeGridBounds(int face, int gridX, int gridY);
+	int buildCullNode(int face, int minGX, int minGY, int maxGX, int maxGY);
+	static CullBounds mergeBounds(const CullBounds* bounds, int count);
+	bool inline isBackFacing(const CullBounds& b, const glm::vec3& pos);
+	void cullNode(int face, int node, const glm::vec3& pos, const Horizon& horizon, int lod);
+	float transitionPriority(int f, int x, int y, const glm::vec3& pos);
+	//Picks the coarsest LOD that looks correct enough from pos
+	int selectLod(int f, int x, int y, const glm::vec3& pos);
+	//Gets the furthest a LOD of a grid is from the true surface
+	float getGridError(int l, int face, int gridX, int gridY);
+
 
-	//LOD helper function
+	//LOD helper functions
 	void inline changeParent(PlanetMeshes &m, SceneObject* parent);
+	void inline setVisible(PlanetMeshes &m, bool visible);
+	//Takes the grid's attached LOD out of the scene
+	void detachChunk(int f, int x, int y);
+	//Collision octrees of a LOD0 chunk being built on another thread, only handed to the meshes once done
+	struct OctreeBuild {
+		int face;
+		int x;
+		int y;
+		Mesh* meshes[3];
+		Octree* trees[3];
+		std::atomic<bool> done;
+		std::thread thread;
+	};
+	//Starts building the collision octrees of a LOD0 chunk
+	void startOctrees(int face, int gridX, int gridY);
+	//Hands any finished octrees to their meshes
+	void collectOctrees();
+	//Waits for a build and hands its octrees over
+	void finishOctrees(OctreeBuild* b);
 
 	std::vector<std::vector<std::vector<float>>> heightmap;
 	glm::mat4 faceTrans[6];
@@ -82,6 +179,8 @@ private:
 	std::vector<glm::vec2> uv;
 	std::vector<glm::vec3> norm;
 	int nodesInGrid;
+	//Point the vertices of the grid being built are relative to
+	glm::dvec3 gridOrigin;
 
 	//Store the meshes at different Level of Detail
 	//LOD       Face        GridX       GridY       Meshes
@@ -89,11 +188,51 @@ private:
 	//Stores the last LOD a grid was rendered at
 	//Face     GridX       GridY
 	std::vector<std::vector<std::vector<int>>> lastLOD;
+	//The LOD of each grid that is in the scene, kept while the grid is hidden so it still casts shadows
+	//Face     GridX       GridY
+	std::vector<std::vector<std::vector<int>>> attachedLOD;
+	//The LOD each grid should be at, reached over a few frames
+	//Face     GridX       GridY
+	std::vector<std::vector<std::vector<int>>> targetLOD;
+	//Grids waiting to change LOD, most important first
+	std::vector<Transition> pending;
+	int maxTransitions;
+	int maxMicros;
+	//Current LOD state, only changed once past the hysteresis margins
+	int currentLod = NUM_LOD - 1;
+	bool nearSurface = false;
+	int centreFace = -1;
+	int centreX = 0;
+	int centreY = 0;
+	//Bounds of each grid, kept when chunks are evicted
+	//Face     GridX       GridY
+	std::vector<std::vector<std::vector<CullBounds>>> gridBounds;
+	//Maximum geometric error of each LOD of each grid, in world units
+	//Face     GridX       GridY       LOD
+	std::vector<std::vector<std::vector<std::vector<float>>>> gridErrors;
+	//Camera LOD is chosen for, and the scale that turns error / distance into pixels
+	Camera* viewCamera;
+	float errorScale;
+	float pixelError;
+	//Culling quadtree nodes, faceRoots[f] is the root of face f
+	std::vector<CullNode> cullNodes;
+	int faceRoots[6];
+	//Radius of a sphere that is always beneath the surface (planetScale * (1 + lowest height))
+	float occluderRadius = 0.0f;
 
 	//Last position scene was updated from
 	glm::vec3 lastPos;
-	//Threads used to speed up octree generation
-	std::unordered_set<std::thread*> threads;
+	//Collision octrees still being built
+	std::vector<OctreeBuild*> octreeBuilds;
+	//Depth of the collision octrees
+	int octDepth = 0;
+	//Holds the geometry of every chunk, so visible chunks are drawn a few at a time
+	MeshArena arena;
+	//Owns every chunk mesh, so the whole planet can be freed at once
+	Pool<Mesh> meshPool;
+	//Tracks chunk memory use, evicting unused chunks when over budget
+	ChunkResidency* residency;
+	ChunkResidency localResidency;
 
 	//Generator settings
 	int nodesExp = 7;